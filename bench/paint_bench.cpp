@@ -0,0 +1,525 @@
+#include "DocumentIO.h"
+#include "DocumentLoader.h"
+#include "DocumentRenderer.h"
+#include "LazyDocument.h"
+#include "SpatialIndex.h"
+#include "shapes/LineShape.h"
+#include "shapes/FreehandShape.h"
+#include "shapes/RectangleShape.h"
+#include "shapes/EllipseShape.h"
+#include "shapes/PolygonShape.h"
+#include "shapes/RegularPolygonShape.h"
+#include <QGuiApplication>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QHash>
+#include <QImage>
+#include <QPainter>
+#include <QTemporaryDir>
+#include <QtMath>
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+// All inputs come from fixed seeds so runs are comparable across builds
+static const unsigned Seed = 20240601;
+static const int CanvasSize = 1024;
+
+// Random walk kept inside the CanvasSize square around start
+static QVector<QPoint> randomStroke(int count, unsigned seed = Seed, const QPoint& start = QPoint(0, 0)){
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> step(-6, 6);
+    QVector<QPoint> points;
+    points.reserve(count);
+    QPoint point(CanvasSize / 2, CanvasSize / 2);
+    for(int i = 0; i < count; ++i){
+        point += QPoint(step(rng), step(rng));
+        point.setX(qBound(0, point.x(), CanvasSize - 1));
+        point.setY(qBound(0, point.y(), CanvasSize - 1));
+        points.append(start + point);
+    }
+    return points;
+}
+
+static QVector<QPoint> randomPoints(int count, const QRect& area, unsigned seed = Seed){
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> x(area.left(), area.right());
+    std::uniform_int_distribution<int> y(area.top(), area.bottom());
+    QVector<QPoint> points;
+    points.reserve(count);
+    for(int i = 0; i < count; ++i)
+        points.append(QPoint(x(rng), y(rng)));
+    return points;
+}
+
+static QPolygon regularPolygon(int count, const QPoint& center, int radius){
+    QPolygon polygon;
+    for(int i = 0; i < count; ++i){
+        double angle = 2 * M_PI * i / count;
+        polygon << center + QPoint(qRound(radius * qCos(angle)), qRound(radius * qSin(angle)));
+    }
+    return polygon;
+}
+
+// One representative shape per type; points sets the vertex count where it applies
+static Shape* makeShape(Shape::Type type, int points = 256){
+    QPoint center(CanvasSize / 2, CanvasSize / 2);
+    Shape* shape = nullptr;
+    switch(type){
+        case Shape::Type::Line:
+            shape = new LineShape(QPoint(100, 150), QPoint(900, 700));
+            break;
+        case Shape::Type::Freehand:
+            shape = new FreehandShape(randomStroke(points));
+            break;
+        case Shape::Type::Rectangle:
+            shape = new RectangleShape(QRect(200, 250, 600, 400));
+            break;
+        case Shape::Type::Ellipse:
+            shape = new EllipseShape(center, 350, 200);
+            break;
+        case Shape::Type::Polygon:{
+            PolygonShape* polygon = new PolygonShape(regularPolygon(points, center, 400));
+            polygon->closePolygon();
+            shape = polygon;
+            break;
+        }
+        case Shape::Type::RegularPolygon:
+            shape = new RegularPolygonShape(center, 400, 7);
+            break;
+    }
+    shape->setPenWidth(3);
+    shape->setFillColor(QColor(40, 120, 200, 128));
+    shape->setRotationAngle(15);
+    return shape;
+}
+
+static QString typeName(Shape::Type type){
+    switch(type){
+        case Shape::Type::Line: return "Line";
+        case Shape::Type::Freehand: return "Freehand";
+        case Shape::Type::Rectangle: return "Rectangle";
+        case Shape::Type::Ellipse: return "Ellipse";
+        case Shape::Type::Polygon: return "Polygon";
+        case Shape::Type::RegularPolygon: return "RegularPolygon";
+    }
+    return QString();
+}
+
+static bool hasVertexCount(Shape::Type type){
+    return type == Shape::Type::Freehand || type == Shape::Type::Polygon;
+}
+
+static const Shape::Type AllTypes[] = {
+    Shape::Type::Line, Shape::Type::Freehand, Shape::Type::Rectangle,
+    Shape::Type::Ellipse, Shape::Type::Polygon, Shape::Type::RegularPolygon
+};
+
+// Synthetic document: a mix of all shape types scattered over a large sheet
+static QList<Shape*> scatteredShapes(int count){
+    std::mt19937 rng(Seed + count);
+    std::uniform_int_distribution<int> position(0, 20000);
+    std::uniform_int_distribution<int> size(4, 200);
+    std::uniform_int_distribution<int> kind(0, 5);
+
+    QList<Shape*> shapes;
+    shapes.reserve(count);
+    for(int i = 0; i < count; ++i){
+        QPoint origin(position(rng), position(rng));
+        QRect rect(origin, QSize(size(rng), size(rng)));
+        Shape* shape = nullptr;
+        switch(kind(rng)){
+            case 0: shape = new LineShape(rect.topLeft(), rect.bottomRight()); break;
+            case 1: shape = new FreehandShape(randomStroke(32, Seed + i, origin)); break;
+            case 2: shape = new RectangleShape(rect); break;
+            case 3: shape = new EllipseShape(rect); break;
+            case 4: shape = new PolygonShape(regularPolygon(6, rect.center(), rect.width() / 2)); break;
+            default: shape = new RegularPolygonShape(rect.center(), rect.width() / 2, 5); break;
+        }
+        shape->setPenWidth(1 + i % 5);
+        shape->setFillColor(QColor::fromRgb(rng()));
+        shapes.append(shape);
+    }
+    return shapes;
+}
+
+// Documents generated once per size and reused by every document benchmark
+class Documents{
+
+    public:
+        const QList<Shape*>& shapes(int count){
+            auto it = m_shapes.find(count);
+            if(it != m_shapes.end())
+                return *it;
+            return *m_shapes.insert(count, scatteredShapes(count));
+        }
+
+        QString file(int count, DocumentIO::Format format){
+            QString name = m_dir.filePath(QString("doc_%1.%2").arg(count)
+                                          .arg(format == DocumentIO::Format::Binary ? DocumentIO::BinarySuffix : "paint"));
+            if(!QFileInfo::exists(name))
+                DocumentIO::save(shapes(count), name);
+            return name;
+        }
+
+        QString scratch(DocumentIO::Format format) const{
+            return m_dir.filePath(format == DocumentIO::Format::Binary ? "scratch.paintb" : "scratch.paint");
+        }
+
+        ~Documents(){
+            for(const QList<Shape*>& shapes : m_shapes)
+                qDeleteAll(shapes);
+        }
+
+    private:
+        QTemporaryDir m_dir;
+        QHash<int, QList<Shape*>> m_shapes;
+};
+
+static const QVector<qint64> DocumentSizes = {1000, 100000, 1000000};
+static const QVector<qint64> VertexCounts = {64, 1024, 16384};
+
+// Heap bytes in use, or -1 where the C library does not tell
+static qint64 heapInUse(){
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return qint64(info.uordblks + info.hblkhd);
+#else
+    return -1;
+#endif
+}
+
+static void indexShapes(const QList<Shape*>& shapes, SpatialIndex<Shape*>& index){
+    for(int i = 0; i < shapes.size(); ++i)
+        index.insert(shapes[i], shapes[i]->repaintRect(), i + 1);
+}
+
+static QString formatName(DocumentIO::Format format){
+    return format == DocumentIO::Format::Binary ? "Binary" : "Json";
+}
+
+// Registers body under name, run once per argument when args are given
+template <typename Body>
+static benchmark::internal::Benchmark* add(const QString& name, Body body, const QVector<qint64>& args = QVector<qint64>()){
+    benchmark::internal::Benchmark* bench = benchmark::RegisterBenchmark(name.toStdString().c_str(), body);
+    for(qint64 arg : args)
+        bench->Arg(arg);
+    return bench;
+}
+
+static void registerShapeBenchmarks(){
+    for(Shape::Type type : AllTypes){
+        add("BM_Draw_" + typeName(type), [type](benchmark::State& state){
+            std::unique_ptr<Shape> shape(makeShape(type, hasVertexCount(type) ? int(state.range(0)) : 256));
+            QImage image(CanvasSize, CanvasSize, QImage::Format_ARGB32_Premultiplied);
+            image.fill(Qt::white);
+            QPainter painter(&image);
+            for(auto _ : state)
+                shape->draw(&painter);
+            state.SetItemsProcessed(state.iterations());
+        }, hasVertexCount(type) ? VertexCounts : QVector<qint64>());
+
+        add("BM_Contains_" + typeName(type), [type](benchmark::State& state){
+            std::unique_ptr<Shape> shape(makeShape(type, hasVertexCount(type) ? int(state.range(0)) : 256));
+            const QVector<QPoint> queries = randomPoints(1024, shape->boundingRect().adjusted(-20, -20, 20, 20));
+            int i = 0;
+            for(auto _ : state)
+                benchmark::DoNotOptimize(shape->contains(queries[i++ & 1023]));
+            state.SetItemsProcessed(state.iterations());
+        }, hasVertexCount(type) ? VertexCounts : QVector<qint64>());
+    }
+
+    // A CAD-like sheet of same-styled lines, one draw() each and as one batched pass
+    for(bool batched : {false, true}){
+        add(batched ? "BM_DrawLineSheetBatched" : "BM_DrawLineSheet", [batched](benchmark::State& state){
+            const QVector<QPoint> ends = randomPoints(2 * int(state.range(0)), QRect(0, 0, CanvasSize, CanvasSize));
+            QList<Shape*> lines;
+            for(int i = 0; i + 1 < ends.size(); i += 2)
+                lines.append(new LineShape(ends[i], ends[i + 1]));
+            QImage image(CanvasSize, CanvasSize, QImage::Format_ARGB32_Premultiplied);
+            image.fill(Qt::white);
+            QPainter painter(&image);
+            for(auto _ : state){
+                if(batched){
+                    DocumentRenderer::drawShapes(&painter, lines);
+                }
+                else{
+                    for(Shape* line : lines)
+                        line->draw(&painter);
+                }
+            }
+            state.SetItemsProcessed(state.iterations() * state.range(0));
+            qDeleteAll(lines);
+        }, {1000, 10000});
+    }
+
+    // A dense stroke seen from far away; cost should follow the pixels it covers
+    add("BM_DrawFreehandZoomedOut", [](benchmark::State& state){
+        std::unique_ptr<Shape> shape(makeShape(Shape::Type::Freehand, int(state.range(0))));
+        QImage image(CanvasSize, CanvasSize, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::white);
+        QPainter painter(&image);
+        painter.scale(0.05, 0.05);
+        for(auto _ : state)
+            shape->draw(&painter);
+        state.SetItemsProcessed(state.iterations());
+    }, VertexCounts);
+
+    add("BM_FreehandAddPoint", [](benchmark::State& state){
+        const QVector<QPoint> stroke = randomStroke(int(state.range(0)));
+        for(auto _ : state){
+            FreehandShape shape;
+            for(const QPoint& point : stroke)
+                shape.addPoint(point);
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }, {1024, 65536});
+
+    // Same stroke captured with online simplification at the canvas tolerance,
+    // including the bounds recomputed when the stroke is committed
+    add("BM_FreehandAddPointSimplified", [](benchmark::State& state){
+        const QVector<QPoint> stroke = randomStroke(int(state.range(0)));
+        for(auto _ : state){
+            FreehandShape shape;
+            shape.setTolerance(0.75);
+            for(const QPoint& point : stroke)
+                shape.addPoint(point);
+            shape.finishStroke();
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }, {1024, 65536});
+
+    add("BM_FreehandSimplify", [](benchmark::State& state){
+        const QVector<QPoint> stroke = randomStroke(int(state.range(0)));
+        FreehandShape shape;
+        for(auto _ : state){
+            state.PauseTiming();
+            shape.setPoints(stroke);
+            state.ResumeTiming();
+            shape.simplify(1.5);
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }, {1024, 65536});
+
+    // The polygon is cached per angle, so every iteration asks for a new angle
+    add("BM_EllipseRotatedPolygon", [](benchmark::State& state){
+        int radius = int(state.range(0));
+        EllipseShape shape(QPoint(0, 0), radius, radius / 2);
+        int step = 0;
+        for(auto _ : state){
+            shape.setRotationAngle(0.5 + (step++ % 720) * 0.5);
+            benchmark::DoNotOptimize(shape.rotatedPolygon());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }, {16, 256, 4096});
+}
+
+static void registerDocumentBenchmarks(Documents& documents){
+    for(DocumentIO::Format format : {DocumentIO::Format::Json, DocumentIO::Format::Binary}){
+        add("BM_Save" + formatName(format), [format, &documents](benchmark::State& state){
+            const QList<Shape*>& shapes = documents.shapes(int(state.range(0)));
+            QString fileName = documents.scratch(format);
+            for(auto _ : state){
+                if(!DocumentIO::save(shapes, fileName)){
+                    state.SkipWithError("save failed");
+                    break;
+                }
+            }
+            state.SetItemsProcessed(state.iterations() * state.range(0));
+            state.SetBytesProcessed(state.iterations() * QFileInfo(fileName).size());
+        }, DocumentSizes);
+
+        add("BM_Load" + formatName(format), [format, &documents](benchmark::State& state){
+            QString fileName = documents.file(int(state.range(0)), format);
+            for(auto _ : state){
+                QList<Shape*> shapes;
+                bool ok = DocumentIO::load(fileName, shapes);
+                state.PauseTiming();
+                qDeleteAll(shapes);
+                state.ResumeTiming();
+                if(!ok){
+                    state.SkipWithError("load failed");
+                    break;
+                }
+            }
+            state.SetItemsProcessed(state.iterations() * state.range(0));
+            state.SetBytesProcessed(state.iterations() * QFileInfo(fileName).size());
+        }, DocumentSizes);
+
+        // Decoding runs on pool threads, so only wall time is meaningful
+        add("BM_LoadParallel" + formatName(format), [format, &documents](benchmark::State& state){
+            QString fileName = documents.file(int(state.range(0)), format);
+            for(auto _ : state){
+                DocumentLoader loader;
+                QEventLoop loop;
+                bool ok = false;
+                QObject::connect(&loader, &DocumentLoader::finished, &loop, [&loop, &ok](bool result){
+                    ok = result;
+                    loop.quit();
+                });
+                loader.start(fileName);
+                loop.exec();
+                state.PauseTiming();
+                qDeleteAll(loader.takeShapes());
+                state.ResumeTiming();
+                if(!ok){
+                    state.SkipWithError("load failed");
+                    break;
+                }
+            }
+            state.SetItemsProcessed(state.iterations() * state.range(0));
+            state.SetBytesProcessed(state.iterations() * QFileInfo(fileName).size());
+        }, DocumentSizes)->UseRealTime();
+    }
+
+    // Whole document into a 2048 pixel square, on one thread and split into tiles
+    for(bool tiled : {false, true}){
+        benchmark::internal::Benchmark* bench = add(tiled ? "BM_RenderDocumentTiled" : "BM_RenderDocument",
+                                                    [tiled, &documents](benchmark::State& state){
+            const QList<Shape*>& shapes = documents.shapes(int(state.range(0)));
+            const QRectF source = DocumentRenderer::documentBounds(shapes);
+            QImage image(2 * CanvasSize, 2 * CanvasSize, QImage::Format_ARGB32_Premultiplied);
+            for(auto _ : state){
+                if(tiled)
+                    DocumentRenderer::renderTiled(shapes, source, image);
+                else
+                    DocumentRenderer::render(shapes, source, image);
+            }
+            state.SetItemsProcessed(state.iterations() * state.range(0));
+        }, {1000, 100000});
+        if(tiled)
+            bench->UseRealTime();
+    }
+
+    add("BM_LazyOpen", [&documents](benchmark::State& state){
+        QString fileName = documents.file(int(state.range(0)), DocumentIO::Format::Binary);
+        for(auto _ : state){
+            std::unique_ptr<LazyDocument> document(LazyDocument::open(fileName));
+            if(!document){
+                state.SkipWithError("open failed");
+                break;
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }, DocumentSizes);
+}
+
+// Cost of the document model per shape: shapes are QObjects, and the canvas
+// walks them through the spatial index, whose bounds and z values sit in
+// dense arrays. The DeleteShapes pair compares the canvas owning shapes
+// explicitly with parenting them to a QObject, as it used to.
+static void registerStorageBenchmarks(Documents& documents){
+    // Heap bytes per shape, for the shapes and the document list, then for their index entries
+    add("BM_DocumentMemory", [](benchmark::State& state){
+        if(heapInUse() < 0){
+            state.SkipWithError("heap usage is not available on this platform");
+            return;
+        }
+        const int count = int(state.range(0));
+        qint64 shapeBytes = 0;
+        qint64 indexBytes = 0;
+        for(auto _ : state){
+            qint64 before = heapInUse();
+            QList<Shape*> shapes = scatteredShapes(count);
+            qint64 built = heapInUse();
+            SpatialIndex<Shape*> index;
+            indexShapes(shapes, index);
+            shapeBytes = built - before;
+            indexBytes = heapInUse() - built;
+
+            state.PauseTiming();
+            index.clear();
+            qDeleteAll(shapes);
+            state.ResumeTiming();
+        }
+        state.counters["shape_bytes"] = benchmark::Counter(double(shapeBytes) / count);
+        state.counters["index_bytes"] = benchmark::Counter(double(indexBytes) / count);
+    }, {1000, 100000})->Iterations(1);
+
+    // Shapes in a canvas-sized viewport, in paint order, as paintEvent() collects them
+    add("BM_IndexQueryViewport", [&documents](benchmark::State& state){
+        const QList<Shape*>& shapes = documents.shapes(int(state.range(0)));
+        SpatialIndex<Shape*> index;
+        indexShapes(shapes, index);
+        const QVector<QPoint> corners = randomPoints(256, QRect(0, 0, 20000 - CanvasSize, 20000 - CanvasSize));
+        int next = 0;
+        qint64 found = 0;
+        for(auto _ : state){
+            QVector<Shape*> visible = index.query(QRect(corners[next++ % corners.size()], QSize(CanvasSize, CanvasSize)));
+            found += visible.size();
+            benchmark::DoNotOptimize(visible.data());
+        }
+        state.counters["shapes_per_query"] = benchmark::Counter(double(found) / state.iterations());
+        state.SetItemsProcessed(state.iterations());
+    }, DocumentSizes);
+
+    // Topmost shape under a click, as selectShape() finds it
+    add("BM_IndexHitTest", [&documents](benchmark::State& state){
+        const QList<Shape*>& shapes = documents.shapes(int(state.range(0)));
+        SpatialIndex<Shape*> index;
+        indexShapes(shapes, index);
+        const QVector<QPoint> clicks = randomPoints(256, QRect(0, 0, 20000, 20000));
+        int next = 0;
+        for(auto _ : state){
+            const QPoint& click = clicks[next++ % clicks.size()];
+            QVector<Shape*> candidates = index.query(click);
+            Shape* hit = nullptr;
+            for(int i = candidates.size() - 1; i >= 0 && !hit; --i){
+                if(candidates[i]->contains(click))
+                    hit = candidates[i];
+            }
+            benchmark::DoNotOptimize(hit);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }, DocumentSizes);
+
+    // Shapes deleted one at a time in no particular order, as Delete and undo remove them
+    for(bool parented : {false, true}){
+        add(parented ? "BM_DeleteShapesParented" : "BM_DeleteShapes", [parented](benchmark::State& state){
+            const int count = int(state.range(0));
+            std::vector<int> order(count);
+            std::iota(order.begin(), order.end(), 0);
+            std::shuffle(order.begin(), order.end(), std::mt19937(Seed));
+            for(auto _ : state){
+                state.PauseTiming();
+                QObject owner;
+                QList<Shape*> shapes = scatteredShapes(count);
+                if(parented){
+                    for(Shape* shape : shapes)
+                        shape->setParent(&owner);
+                }
+                state.ResumeTiming();
+
+                for(int i : order)
+                    delete shapes[i];
+            }
+            state.SetItemsProcessed(state.iterations() * count);
+        }, {1000, 10000});
+    }
+}
+
+// Takes the usual Google Benchmark flags, e.g.
+// paint_bench --benchmark_filter=BM_Draw --benchmark_format=json --benchmark_out=results.json
+int main(int argc, char* argv[])
+{
+    benchmark::Initialize(&argc, argv);
+
+    // Rendering goes to QImage only, no display is needed
+    if(qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+
+    Documents documents;
+    registerShapeBenchmarks();
+    registerDocumentBenchmarks(documents);
+    registerStorageBenchmarks(documents);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,98 @@
+#ifndef ANIMATIONMANAGER_H
+#define ANIMATIONMANAGER_H
+
+#include "./shapes/Shape.h"
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QVariant>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QEasingCurve>
+#include <functional>
+
+// Runs shape animations from a single frame clock. One timer ticks at the
+// display refresh rate; every tick evaluates all tracks at the same time
+// stamp with the shapes' shapeChanged signals blocked, then reports the
+// touched shapes once through frameAdvanced().
+//
+// Each animated shape keeps a snapshot of its state without the running
+// tracks. A tick restores that snapshot and applies every track from it, so
+// relative transforms on integer geometry do not drift from frame to frame.
+class AnimationManager : public QObject{
+
+    Q_OBJECT
+
+    public:
+        enum class Property{
+            Rotation,   // degrees, relative to the start
+            Scale,      // factor, relative to the start
+            Offset,     // QPoint, relative to the start
+            PenColor,   // target QColor
+            FillColor   // target QColor
+        };
+
+        enum class Loop{
+            Once,
+            Repeat,
+            PingPong
+        };
+
+        explicit AnimationManager(QObject* parent = nullptr);
+
+        // Replaces a running track of the same property on the shape, keeping its current value
+        void animate(Shape* shape, Property property, const QVariant& to, int durationMs,
+                     Loop loop = Loop::Once, const QEasingCurve& curve = QEasingCurve(QEasingCurve::InOutQuad));
+
+        // Leaves the shape as the last frame showed it. Edits stop the
+        // animation first, since the next tick would rebuild the shape from
+        // its base and lose them.
+        void stop(Shape* shape);
+        void stopAll();
+        // Puts the shape back in its state without the running tracks, for
+        // shapes leaving the document
+        void forget(Shape* shape);
+        void clear();
+
+        bool isAnimating(Shape* shape) const;
+        int count() const;
+
+        void setFrameRate(qreal framesPerSecond);
+
+    signals:
+        void frameAdvanced(const QVector<Shape*>& shapes);
+        void finished(Shape* shape);
+
+    private:
+        struct Track{
+            Property property;
+            QVariant to;
+            QColor from;
+            qint64 start;
+            int duration;
+            Loop loop;
+            QEasingCurve curve;
+        };
+
+        struct Entry{
+            QByteArray base;
+            QVector<Track> tracks;
+            qint64 shownAt = 0;     // frame time the shape currently shows
+        };
+
+        void tick();
+        void bake(Shape* shape, Entry& entry, qint64 now, const std::function<bool(const Track&)>& which);
+        void applyTracks(Shape* shape, const Entry& entry, qint64 now) const;
+        void applyTrack(Shape* shape, const Track& track, qreal value) const;
+        qreal progress(const Track& track, qint64 now) const;
+        bool isDone(const Track& track, qint64 now) const;
+
+        static QByteArray snapshot(const Shape* shape);
+        static void restore(Shape* shape, const QByteArray& state);
+
+        QHash<Shape*, Entry> m_entries;
+        QTimer m_timer;
+        QElapsedTimer m_clock;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef BINARYSTREAM_H
+#define BINARYSTREAM_H
+
+#include <QByteArray>
+#include <QColor>
+#include <QPoint>
+#include <QRect>
+#include <QVector>
+
+// Little-endian primitives for the binary document format. Integers are
+// LEB128 varints, signed ones zig-zag encoded; point arrays are delta encoded.
+class BinaryWriter{
+
+    public:
+        explicit BinaryWriter(QByteArray* buffer);
+
+        void writeByte(quint8 value);
+        void writeUInt16(quint16 value);
+        void writeUInt32(quint32 value);
+        void writeVarint(quint64 value);
+        void writeSVarint(qint64 value);
+        void writeDouble(double value);
+        void writeColor(const QColor& color);
+        void writePoint(const QPoint& point);
+        void writeRect(const QRect& rect);
+        void writePoints(const QVector<QPoint>& points);
+        void writeBytes(const QByteArray& bytes);
+
+    private:
+        QByteArray* m_buffer;
+};
+
+class BinaryReader{
+
+    public:
+        BinaryReader(const char* data, qint64 size);
+
+        bool atEnd() const;
+        bool hasError() const;
+        qint64 position() const;
+        qint64 remaining() const;
+        const char* current() const;
+
+        quint8 readByte();
+        quint16 readUInt16();
+        quint32 readUInt32();
+        quint64 readVarint();
+        qint64 readSVarint();
+        double readDouble();
+        QColor readColor();
+        QPoint readPoint();
+        QRect readRect();
+        QVector<QPoint> readPoints();
+
+        // Reader over the next length bytes; this reader skips past them
+        BinaryReader subReader(qint64 length);
+        void skip(qint64 length);
+
+    private:
+        const char* m_data;
+        qint64 m_size;
+        qint64 m_pos = 0;
+        bool m_error = false;
+
+        bool require(qint64 length);
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef CANVASCOMMANDS_H
+#define CANVASCOMMANDS_H
+
+#include "./shapes/Shape.h"
+#include <QUndoCommand>
+#include <QVariant>
+#include <QVector>
+
+class CanvasWidget;
+
+// Undo records for canvas edits. Each one stores only what the edit touched
+// (shape pointers, z values, deltas, old/new property values); shapes taken
+// out of the document are kept alive by the command instead of being copied.
+
+// Puts shapes into the document at fixed z values. Owns them while undone.
+class AddShapesCommand : public QUndoCommand{
+
+    public:
+        AddShapesCommand(CanvasWidget* canvas, const QVector<Shape*>& shapes, const QVector<qint64>& z,
+                         const QString& text, QUndoCommand* parent = nullptr);
+        ~AddShapesCommand() override;
+
+        void undo() override;
+        void redo() override;
+
+    private:
+        CanvasWidget* m_canvas;
+        QVector<Shape*> m_shapes;
+        QVector<qint64> m_z;
+        bool m_inDocument = false;
+};
+
+// Takes shapes out of the document, remembering their z values. Owns them while done.
+class RemoveShapesCommand : public QUndoCommand{
+
+    public:
+        RemoveShapesCommand(CanvasWidget* canvas, const QVector<Shape*>& shapes,
+                            const QString& text, QUndoCommand* parent = nullptr);
+        ~RemoveShapesCommand() override;
+
+        void undo() override;
+        void redo() override;
+
+    private:
+        CanvasWidget* m_canvas;
+        QVector<Shape*> m_shapes;
+        QVector<qint64> m_z;
+        bool m_inDocument = true;
+};
+
+class ZOrderCommand : public QUndoCommand{
+
+    public:
+        ZOrderCommand(CanvasWidget* canvas, Shape* shape, qint64 z, const QString& text, QUndoCommand* parent = nullptr);
+
+        void undo() override;
+        void redo() override;
+
+    private:
+        CanvasWidget* m_canvas;
+        Shape* m_shape;
+        qint64 m_oldZ;
+        qint64 m_newZ;
+};
+
+// Edits of a shape's own state stop its animation before applying, so the
+// next frame does not rebuild the shape without them.
+
+// Consecutive moves of the same shape merge into one step
+class MoveShapeCommand : public QUndoCommand{
+
+    public:
+        MoveShapeCommand(CanvasWidget* canvas, Shape* shape, const QPoint& offset, QUndoCommand* parent = nullptr);
+
+        void undo() override;
+        void redo() override;
+        int id() const override;
+        bool mergeWith(const QUndoCommand* other) override;
+
+    private:
+        CanvasWidget* m_canvas;
+        Shape* m_shape;
+        QPoint m_offset;
+};
+
+// Consecutive edits of the same property on the same shape merge into one step
+class ShapePropertyCommand : public QUndoCommand{
+
+    public:
+        enum class Property{
+            PenColor,
+            PenWidth,
+            FillColor
+        };
+
+        ShapePropertyCommand(CanvasWidget* canvas, Shape* shape, Property property, const QVariant& value,
+                             QUndoCommand* parent = nullptr);
+
+        void undo() override;
+        void redo() override;
+        int id() const override;
+        bool mergeWith(const QUndoCommand* other) override;
+
+    private:
+        CanvasWidget* m_canvas;
+        Shape* m_shape;
+        Property m_property;
+        QVariant m_oldValue;
+        QVariant m_newValue;
+
+        static QVariant read(const Shape* shape, Property property);
+        static void write(Shape* shape, Property property, const QVariant& value);
+};
+
+#endif
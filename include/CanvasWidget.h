@@ -2,7 +2,19 @@
 #define CANVASWIDGET_H
 
 #include "./shapes/Shape.h"
+#include "SpatialIndex.h"
+#include "LazyDocument.h"
+#include "DocumentSaver.h"
+#include "DocumentJournal.h"
+#include "FrameStats.h"
+#include "AnimationManager.h"
 #include <QWidget>
+#include <QHash>
+#include <QSet>
+#include <QImage>
+#include <QSharedPointer>
+#include <QTimer>
+#include <QUndoStack>
 
 class CanvasWidget : public QWidget{
 
@@ -10,6 +22,7 @@ class CanvasWidget : public QWidget{
 
     public:
         explicit CanvasWidget(QWidget* parent = nullptr);
+        ~CanvasWidget() override;
 
         QColor penColor();
         QColor fillColor();
@@ -18,10 +31,23 @@ class CanvasWidget : public QWidget{
         void setPenColor(const QColor& color);
         void setPenWidth(int width);
         void setFillColor(const QColor& color);
+        // Simplification tolerance in pixels for freehand strokes drawn from now on
+        double strokeTolerance() const;
+        void setStrokeTolerance(double tolerance);
         
+        // Returns once the save is started, false if it could not be; the
+        // result arrives through saveFinished()
         bool saveToFile(const QString& filename);
+        // Blocks until every running save is written and reported; false if
+        // the last of them failed
+        bool waitForSave();
         bool loadFromFile(const QString& filename);
+        // Whether the last failed load was cancelled by the user rather than broken
+        bool loadCancelled() const;
+        // Loads the file with the edits from its journal applied, as a modified document
+        bool recoverFile(const QString& filename);
         
+        void newDocument();
         void clearCanvas();
         void deleteSelectedShape();
         void bringToFront();
@@ -30,9 +56,36 @@ class CanvasWidget : public QWidget{
         void startAnimation();
         void stopAnimation();
 
+        // View onto the document: widget = document * zoom + pan
+        qreal zoom() const;
+        // Keeps the document point under anchor (widget coordinates) in place
+        void setZoom(qreal zoom, const QPointF& anchor);
+        void zoomIn();
+        void zoomOut();
+        void resetView();
+        void panBy(const QPoint& delta);
+        QRect visibleDocumentRect() const;
+
+        QUndoStack* undoStack();
+        AnimationManager* animations();
+
+        // Document primitives behind the undo commands; they record no history
+        void addShapes(const QVector<Shape*>& shapes, const QVector<qint64>& z);
+        void removeShapes(const QVector<Shape*>& shapes);
+        void setShapeZ(Shape* shape, qint64 z);
+        qint64 shapeZ(Shape* shape) const;
+
+#ifdef PAINT_INSTRUMENTATION
+        bool isStatsHudVisible() const;
+        void setStatsHudVisible(bool visible);
+        bool dumpFrameStats(const QString& fileName) const;
+#endif
+
     signals:
         void shapeSelected(const QString& shapeInfo);
         void fileModified(bool modified);
+        void saveFinished(const QString& fileName, bool ok);
+        void zoomChanged(qreal zoom);
 
     protected:
         void paintEvent(QPaintEvent* event) override;
@@ -40,8 +93,10 @@ class CanvasWidget : public QWidget{
         void mouseMoveEvent(QMouseEvent* event) override;
         void mouseReleaseEvent(QMouseEvent* event) override;
         void mouseDoubleClickEvent(QMouseEvent* event) override;
-        void resizeEvent(QResizeEvent* event) override;
         void contextMenuEvent(QContextMenuEvent* event) override;
+        void keyPressEvent(QKeyEvent* event) override;
+        void wheelEvent(QWheelEvent* event) override;
+        bool event(QEvent* event) override;
 
     private:
         QList<Shape*> m_shapes;
@@ -50,19 +105,111 @@ class CanvasWidget : public QWidget{
         QPoint m_lastPoint;
         bool m_isDrawing = false;
         bool m_isModified = false;
+        bool m_loadCancelled = false;
         QColor m_penColor = Qt::black;
         int m_penWidth = 1;
         QColor m_fillColor = Qt::transparent;
+        double m_strokeTolerance = 0.75;
 
         Shape* m_selectedShape = nullptr;
         QPoint m_lastMousePos;
         bool m_dragging = false;
         bool m_resizing = false;
 
+        qreal m_zoom = 1.0;
+        QPointF m_pan;
+        bool m_panning = false;
+
+        static constexpr qreal MinZoom = 1.0 / 64;
+        static constexpr qreal MaxZoom = 64.0;
+        static constexpr qreal ZoomStep = 1.25;
+        static const int PanStep = 40;
+
+        // Committed shapes with their painted rects and z values
+        SpatialIndex<Shape*> m_index;
+        qint64 m_topZ = 0;
+        qint64 m_bottomZ = 0;
+        // Painted rects of shapes that are not committed yet (the one being drawn)
+        QHash<Shape*, QRect> m_pendingRects;
+        // Records of a binary document that have not been decoded yet, shared with running saves
+        QSharedPointer<LazyDocument> m_lazyDocument;
+        // Encoded form of committed shapes that have not changed since the last save
+        QHash<Shape*, DocumentIO::Record> m_recordCache;
+        DocumentSaver m_saver;
+
+        // Write-ahead log of edits to the open file; saves compact it into the file
+        DocumentJournal m_journal;
+        QHash<Shape*, quint64> m_journalIds;
+        quint64 m_nextJournalId = 1;
+        // Changed shapes are written to the journal together, once per JournalDelay
+        QSet<Shape*> m_journalDirty;
+        QTimer m_journalTimer;
+
+        struct PendingSave{
+            QString fileName;
+            QVector<DocumentJournal::Slot> slots;
+            qint64 journalPosition;
+            quint64 historyStep;    // m_historySteps when the save started
+            bool current;   // false once the document it was taken from is gone
+        };
+        QList<PendingSave> m_pendingSaves;
+        // Counts undo stack moves; a save marks the stack clean only if none happened since it started
+        quint64 m_historySteps = 0;
+
+        static const int JournalDelay = 500;
+        static const qint64 JournalCompactBytes = 4 << 20;
+
+        // Committed shapes rendered once through the view; only m_staticDirty
+        // (widget coordinates) is redrawn into it
+        QImage m_staticLayer;
+        QRegion m_staticDirty;
+        // Repaints at least this many device pixels go through DocumentRenderer::renderTiled()
+        static const int TiledRepaintPixels = 1024 * 1024;
+
+        AnimationManager m_animations;
+        QUndoStack m_undoStack;
+
+#ifdef PAINT_INSTRUMENTATION
+        FrameStats m_stats;
+        // Repaints the HUD while it is shown, its numbers change without input
+        QTimer m_hudTimer;
+#endif
+
         Shape* createShape(const QString& shapeType);
         void selectShape(const QPoint& point);
-        void scaleShapes(double factor);
         void updateSelection();
+
+        void resetDocument();
+        void insertShape(Shape* shape, qint64 z);
+        void insertSorted(Shape* shape, qint64 z);
+        QList<Shape*>::iterator findShape(Shape* shape);
+        void commitShape(Shape* shape);
+        void materialize(const QRect& rect);
+        void materializeAll();
+        void adoptRecords(const QVector<int>& records);
+        DocumentSnapshot takeSnapshot(QVector<DocumentJournal::Slot>& slots, DocumentIO::Format format);
+        const DocumentIO::Record& cachedRecord(Shape* shape);
+        void trackShape(Shape* shape);
+        void handleShapeChanged();
+        void untrackShape(Shape* shape);
+        quint64 journalId(Shape* shape);
+        void journalShape(Shape* shape);
+        void flushJournal();
+        void handleSaveFinished(const QString& fileName, bool ok);
+        void invalidateShape(Shape* shape);
+        // Document rects unless noted; shapes and the index live in document coordinates
+        QTransform viewTransform() const;
+        QPoint toDocument(const QPoint& pos) const;
+        QRect toDocument(const QRect& rect) const;
+        QRect toView(const QRect& rect) const;
+        void updateDocument(const QRect& rect);
+        void invalidateStatic(const QRect& rect);
+        void invalidateStatic(const QRegion& region);
+        void invalidateView();
+        void scrollStaticLayer(const QPoint& delta);
+        void handleAnimationFrame(const QVector<Shape*>& shapes);
+        void handleAnimationFinished(Shape* shape);
+        void updateStaticLayer();
 };
 
 #endif
\ No newline at end of file
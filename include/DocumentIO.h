@@ -0,0 +1,74 @@
+#ifndef DOCUMENTIO_H
+#define DOCUMENTIO_H
+
+#include "./shapes/Shape.h"
+#include <QList>
+#include <QVector>
+#include <QString>
+
+class QIODevice;
+
+// Loading and saving of shape documents. The format is picked from the file
+// extension: ".paintb" is the chunked binary format, anything else is JSON.
+//
+// Binary layout (little endian):
+//   header  "PNTB" magic, u16 version, u16 flags
+//   chunk   u32 byte length, u32 shape count, records...   (repeated)
+//   end     u32 0, u32 0
+//   record  u8 type, painted bounds (4 zig-zag varints), varint payload length, payload
+class DocumentIO{
+
+    public:
+        enum class Format{
+            Json,
+            Binary
+        };
+
+        // Location of one shape record inside a binary document
+        struct BinaryRecord{
+            Shape::Type type;
+            QRect bounds;
+            qint64 offset;
+            qint64 length;
+        };
+
+        // One shape already encoded, e.g. for writing from a worker thread
+        struct Record{
+            Shape::Type type;
+            QRect bounds;
+            QByteArray payload;
+        };
+
+        static const char* BinarySuffix;
+
+        static Format formatForFile(const QString& fileName);
+
+        // Saves go through a temporary file that replaces fileName only once fully written
+        static bool save(const QList<Shape*>& shapes, const QString& fileName);
+        // Records are already in the binary format; fails for a JSON fileName
+        static bool save(const QVector<Record>& records, const QString& fileName);
+        static bool load(const QString& fileName, QList<Shape*>& shapes);
+
+        static bool writeJson(const QList<Shape*>& shapes, QIODevice* device);
+        static bool readJson(const QByteArray& data, QList<Shape*>& shapes);
+        static bool writeBinary(const QList<Shape*>& shapes, QIODevice* device);
+        static bool readBinary(const char* data, qint64 size, QList<Shape*>& shapes);
+        static bool scanBinary(const char* data, qint64 size, QVector<BinaryRecord>& records);
+        static Shape* decodeRecord(const char* data, const BinaryRecord& record);
+
+        // Records hold no reference to their shape, so they can be written from any thread
+        static Record encodeRecord(const Shape* shape);
+        static Shape* decodeRecord(const Record& record);
+        static bool writeBinary(const QVector<Record>& records, QIODevice* device);
+
+        static bool isKnownType(Shape::Type type);
+        static Shape* createShape(Shape::Type type);
+        static Shape* createShape(const QString& jsonType);
+
+    private:
+        static const quint16 BinaryVersion = 1;
+        static const int ChunkShapes = 4096;
+        static const int ChunkBytes = 1 << 20;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef DOCUMENTJOURNAL_H
+#define DOCUMENTJOURNAL_H
+
+#include "DocumentIO.h"
+#include <QFile>
+#include <functional>
+
+class BinaryReader;
+
+// Write-ahead log of edits kept next to a saved document as "<document>.journal".
+// The saved file with the journal replayed on top of it is the current
+// document, so autosave costs one entry per edit instead of a full rewrite.
+// The journal file is only created by the first edit.
+//
+// Shapes are named by ids that stay fixed for a session. Shapes of the saved
+// file get ids and z values 1..n in file order, unless the journal starts with
+// a Base entry listing them; rebase() writes one after every save.
+//
+// Layout (little endian):
+//   header  "PNTJ" magic, u16 version, varint document size, svarint document mtime (ms)
+//   entry   u8 op, varint payload length, u16 payload checksum, payload   (repeated)
+// Replay stops at the first entry that is cut short or fails its checksum,
+// which is what a crash in the middle of an append leaves behind.
+class DocumentJournal{
+
+    public:
+        // Id and z of one shape of the saved document
+        struct Slot{
+            quint64 id;
+            qint64 z;
+        };
+
+        struct Entry{
+            quint64 id;
+            qint64 z;
+            DocumentIO::Record record;
+        };
+
+        ~DocumentJournal();
+
+        static QString fileName(const QString& documentFile);
+        // Whether the document has a journal with edits that was written against its current contents
+        static bool canRecover(const QString& documentFile);
+        // Shapes of the document with its journal applied, in z order
+        static bool replay(const QString& documentFile, QVector<Entry>& entries);
+
+        // Journals edits of documentFile from now on, dropping any earlier journal
+        void setDocument(const QString& documentFile);
+        // Keeps appending to the journal of documentFile, after the last intact entry
+        bool resume(const QString& documentFile);
+        // Closes the journal and deletes its file
+        void discard();
+
+        QString document() const;
+        // Bytes of edit entries written so far, not counting the Base entry
+        qint64 position() const;
+        // Bytes of edit entries the last compact() left, 0 before the first
+        qint64 compactedSize() const;
+
+        bool put(quint64 id, qint64 z, const DocumentIO::Record& record);
+        bool remove(quint64 id);
+        bool setZ(quint64 id, qint64 z);
+
+        // Starts a new journal for a document that was just saved with the given
+        // shapes. Entries written after position from are carried over.
+        bool rebase(const QString& documentFile, const QVector<Slot>& slots, qint64 from);
+        // Rewrites the journal with one entry per shape that has edits, its net
+        // change since the saved document. Replays the same; positions taken
+        // before it are no longer valid.
+        bool compact();
+
+    private:
+        enum class Op : quint8{
+            Base = 1,
+            Put,
+            Remove,
+            SetZ
+        };
+
+        // Where the entries of a journal file start and end
+        struct Extent{
+            qint64 base = 0;    // first entry, a Base entry if there is one
+            qint64 edits = 0;   // first entry after the Base entry
+            qint64 end = 0;     // end of the last intact entry
+        };
+
+        bool append(Op op, const QByteArray& payload);
+        bool ensureOpen();
+
+        static QByteArray header(const QString& documentFile);
+        static QByteArray putPayload(quint64 id, qint64 z, const DocumentIO::Record& record);
+        static QByteArray entry(Op op, const QByteArray& payload);
+        // Calls visit for every intact entry; fails if the journal does not belong to the document as it is now
+        static bool walk(const QByteArray& data, const QString& documentFile, Extent& extent,
+                         const std::function<bool(Op, BinaryReader&)>& visit);
+
+        static const quint16 Version = 1;
+
+        QString m_document;
+        QFile m_file;
+        // Base entry of the last rebase, written together with the header by the first edit
+        QByteArray m_base;
+        qint64 m_editsStart = 0;
+        qint64 m_position = 0;
+        qint64 m_compactedSize = 0;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef DOCUMENTLOADER_H
+#define DOCUMENTLOADER_H
+
+#include "DocumentIO.h"
+#include <QObject>
+#include <QThreadPool>
+#include <QJsonArray>
+#include <QAtomicInt>
+#include <QMutex>
+
+class QThread;
+
+// Decodes a document on a thread pool. The file is split into chunks of
+// shapes that are parsed in parallel into unparented shapes, which are then
+// moved to the thread that called start(). Signals arrive on that thread.
+class DocumentLoader : public QObject{
+
+    Q_OBJECT
+
+    public:
+        explicit DocumentLoader(QObject* parent = nullptr);
+        ~DocumentLoader() override;
+
+        void start(const QString& fileName);
+        void cancel();
+        bool isRunning() const;
+
+        // Decoded shapes in document order, ownership goes to the caller
+        QList<Shape*> takeShapes();
+
+    signals:
+        void progress(int done, int total);
+        void finished(bool ok);
+
+    private:
+        void prepare(const QString& fileName);
+        void decodeJson(int chunk, const QJsonArray& array, int begin, int end);
+        void decodeBinary(int chunk, int begin, int end);
+        void finishChunk(int chunk, const QList<Shape*>& shapes, bool ok);
+        void fail();
+
+        static const int ChunkShapes = 512;
+
+        QThreadPool m_pool;
+        QThread* m_target = nullptr;
+        QAtomicInt m_cancelled;
+        bool m_running = false;
+
+        // Binary documents are decoded straight out of the file contents
+        QByteArray m_data;
+        QVector<DocumentIO::BinaryRecord> m_records;
+
+        QMutex m_mutex;
+        QVector<QList<Shape*>> m_chunks;
+        int m_total = 0;
+        int m_done = 0;
+        int m_pendingChunks = 0;
+        bool m_ok = true;
+};
+
+#endif
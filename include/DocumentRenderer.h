@@ -0,0 +1,49 @@
+#ifndef DOCUMENTRENDERER_H
+#define DOCUMENTRENDERER_H
+
+#include "./shapes/Shape.h"
+#include <QList>
+#include <QImage>
+#include <QTransform>
+
+class QThreadPool;
+
+// Rasterizes shapes into images without a widget. Only QImage painting is
+// involved, so it works on any thread and on the offscreen platform.
+class DocumentRenderer{
+
+    public:
+        // Edge of the square tiles renderTiled() hands to the workers, in device pixels
+        static const int TileSize = 256;
+
+        // Draws shapes in order, as draw() on each would, but sets pen and brush
+        // only where the style changes from one shape to the next, and sends
+        // runs of plain lines and outlined rectangles as one drawLines() or
+        // drawRects() call. Leaves the painter as it found it.
+        static void drawShapes(QPainter* painter, const QList<Shape*>& shapes);
+
+        // Painted area of all shapes, strokes included
+        static QRect documentBounds(const QList<Shape*>& shapes);
+
+        // Draws the part of the document inside source, scaled to fill image.
+        // Shapes whose painted area misses source are skipped.
+        static void render(const QList<Shape*>& shapes, const QRectF& source, QImage& image,
+                           const QColor& background = Qt::white);
+
+        // Same as render(), with the image split into tiles drawn in parallel
+        static void renderTiled(const QList<Shape*>& shapes, const QRectF& source, QImage& image,
+                                const QColor& background = Qt::white, QThreadPool* pool = nullptr);
+
+        // Repaints area (device pixels) of image with the shapes mapped through
+        // transform (document to logical image coordinates), in draw order.
+        // Each tile is drawn by one thread, straight into its part of image,
+        // and only visits the shapes whose painted area reaches it. The calling
+        // thread takes tiles too and returns once all of them are done.
+        // Shapes must not change meanwhile; pool defaults to the global one.
+        // The image needs at least 8 bits per pixel.
+        static void renderTiled(const QList<Shape*>& shapes, const QTransform& transform, QImage& image,
+                                const QRect& area, const QColor& background = Qt::white,
+                                QThreadPool* pool = nullptr);
+};
+
+#endif
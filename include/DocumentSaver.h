@@ -0,0 +1,58 @@
+#ifndef DOCUMENTSAVER_H
+#define DOCUMENTSAVER_H
+
+#include "DocumentIO.h"
+#include "LazyDocument.h"
+#include <QObject>
+#include <QThreadPool>
+#include <QSharedPointer>
+#include <QAtomicInt>
+
+// Immutable copy of a document taken on the GUI thread, in z order. Each item
+// is either an encoded record, which shares its payload bytes, or a copy of a
+// shape that the saver encodes on its own thread. Copies share their point
+// data, so taking a snapshot costs a pointer copy or a small allocation per shape.
+struct DocumentSnapshot{
+    struct Item{
+        DocumentIO::Record record;
+        // Set instead of record; only the saver's thread touches it
+        QSharedPointer<Shape> shape;
+    };
+
+    QVector<Item> items;
+    // Keeps the mapping behind not yet decoded records alive while they are written
+    QSharedPointer<LazyDocument> source;
+};
+
+// Writes snapshots on a background thread, one save at a time in the order
+// they were started. Each save replaces the target file atomically through a
+// temporary file; finished() arrives on the thread that owns the saver.
+class DocumentSaver : public QObject{
+
+    Q_OBJECT
+
+    public:
+        explicit DocumentSaver(QObject* parent = nullptr);
+        ~DocumentSaver() override;
+
+        // False without starting when fileName cannot be written at all;
+        // anything that fails later is reported through finished()
+        bool start(const DocumentSnapshot& snapshot, const QString& fileName);
+        bool isSaving() const;
+
+        // Blocks until every started save is written, returns whether the last one succeeded
+        bool waitForFinished();
+
+    signals:
+        void finished(const QString& fileName, bool ok);
+
+    private:
+        static bool canWrite(const QString& fileName);
+        static bool write(const DocumentSnapshot& snapshot, const QString& fileName);
+
+        QThreadPool m_pool;
+        int m_running = 0;
+        QAtomicInt m_lastOk;
+};
+
+#endif
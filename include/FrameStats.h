@@ -0,0 +1,111 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+// Frame-time instrumentation for the canvas. Everything here is only built
+// with PAINT_INSTRUMENTATION defined; otherwise PAINT_STATS() statements
+// expand to nothing and the class does not exist.
+#ifdef PAINT_INSTRUMENTATION
+#define PAINT_STATS(...) __VA_ARGS__
+#else
+#define PAINT_STATS(...)
+#endif
+
+#ifdef PAINT_INSTRUMENTATION
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QRect>
+#include <QString>
+#include <QVector>
+#include <array>
+
+class QPainter;
+
+// Fixed-size ring of samples. Dumps may read it from another thread than
+// the one pushing, so a mutex guards the slots; it is held for one sample
+// on push and for one copy of the ring on snapshot.
+template <typename T, int Capacity>
+class SampleRing{
+
+    public:
+        void push(const T& sample){
+            QMutexLocker locker(&m_mutex);
+            m_samples[m_head % Capacity] = sample;
+            ++m_head;
+        }
+
+        // Oldest first
+        QVector<T> snapshot() const{
+            QMutexLocker locker(&m_mutex);
+            quint64 first = m_head > quint64(Capacity) ? m_head - Capacity : 0;
+            QVector<T> samples;
+            samples.reserve(int(m_head - first));
+            for(quint64 i = first; i < m_head; ++i)
+                samples.append(m_samples[i % Capacity]);
+            return samples;
+        }
+
+    private:
+        std::array<T, Capacity> m_samples;
+        quint64 m_head = 0;
+        mutable QMutex m_mutex;
+};
+
+class FrameStats{
+
+    public:
+        // All times are nanoseconds since the stats were created
+        struct Frame{
+            qint64 start;
+            qint64 duration;
+            int visited;
+            int drawn;
+            qint64 latency;     // input event to end of paint, -1 without input
+        };
+
+        struct Selection{
+            qint64 start;
+            qint64 duration;
+            int candidates;
+        };
+
+        static const int Capacity = 1024;
+
+        FrameStats();
+
+        qint64 now() const;
+
+        // Remembers the oldest input event not yet followed by a frame
+        void markInput();
+
+        void beginFrame();
+        void addVisited(int count);
+        void addDrawn(int count);
+        void endFrame();
+        void recordSelection(qint64 start, int candidates);
+
+        bool isHudVisible() const;
+        void setHudVisible(bool visible);
+        QRect hudRect() const;
+        void drawHud(QPainter* painter) const;
+
+        // ".json" files get the Chrome trace event format, anything else CSV
+        bool dump(const QString& fileName) const;
+
+    private:
+        QElapsedTimer m_clock;
+        SampleRing<Frame, Capacity> m_frames;
+        SampleRing<Selection, Capacity> m_selections;
+
+        Frame m_current = {};
+        bool m_inFrame = false;
+        qint64 m_pendingInput = -1;
+        bool m_hudVisible = false;
+
+        bool dumpCsv(const QString& fileName) const;
+        bool dumpChromeTrace(const QString& fileName) const;
+};
+
+#endif
+
+#endif
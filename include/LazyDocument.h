@@ -0,0 +1,41 @@
+#ifndef LAZYDOCUMENT_H
+#define LAZYDOCUMENT_H
+
+#include "DocumentIO.h"
+#include "SpatialIndex.h"
+#include <QFile>
+
+// Memory-mapped binary document. Opening only scans the record headers;
+// shapes are decoded one by one when the canvas first needs them.
+class LazyDocument{
+
+    public:
+        ~LazyDocument();
+
+        static LazyDocument* open(const QString& fileName);
+
+        int recordCount() const;
+        int pendingCount() const;
+
+        // Removes the not yet decoded records intersecting rect, in z order
+        QVector<int> take(const QRect& rect);
+        QVector<int> takeAll();
+        Shape* decode(int record) const;
+
+        // The not yet decoded records in z order, left in place
+        QVector<int> pendingRecords() const;
+        // Payload refers into the mapping, so it is only valid while the document lives
+        DocumentIO::Record record(int record) const;
+        QString fileName() const;
+
+    private:
+        LazyDocument() = default;
+
+        QFile m_file;
+        const char* m_data = nullptr;
+        qint64 m_size = 0;
+        QVector<DocumentIO::BinaryRecord> m_records;
+        SpatialIndex<int> m_pending;
+};
+
+#endif
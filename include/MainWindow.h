@@ -28,7 +28,11 @@ private slots:
     void setPenWidth(int width);
     
     void showShapeProperties();
+#ifdef PAINT_INSTRUMENTATION
+    void dumpFrameStats();
+#endif
     void updateStatusBar(const QString& message);
+    void handleSaveFinished(const QString& fileName, bool ok);
 
 private:
     void createActions();
@@ -39,6 +43,8 @@ private:
     bool maybeSave();
     bool saveFile(const QString& fileName);
     bool loadFile(const QString& fileName);
+    void recoverSession();
+    void setSessionDocument(const QString& fileName);
     
     CanvasWidget* m_canvas;
     QString m_currentFile;
@@ -68,12 +74,22 @@ private:
     QAction* m_fillColorAct;
     QAction* m_penWidthAct;
     
+    QAction* m_undoAct;
+    QAction* m_redoAct;
     QAction* m_deleteAct;
     QAction* m_propertiesAct;
     QAction* m_bringToFrontAct;
     QAction* m_sendToBackAct;
     
+    QAction* m_zoomInAct;
+    QAction* m_zoomOutAct;
+    QAction* m_resetViewAct;
+
     QAction* m_aboutAct;
+#ifdef PAINT_INSTRUMENTATION
+    QAction* m_statsHudAct;
+    QAction* m_dumpStatsAct;
+#endif
     
     QActionGroup* m_toolActionGroup;
 };
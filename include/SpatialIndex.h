@@ -0,0 +1,56 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include "./shapes/Shape.h"
+#include <QHash>
+#include <QSet>
+#include <QRect>
+#include <QVector>
+
+// Uniform grid over item bounds (shapes, or record ids of a lazily loaded
+// document). Every entry also carries its z value so queries come back in
+// paint order (back to front). Instantiated for Shape* and int.
+template <typename T>
+class SpatialIndex{
+
+    public:
+        explicit SpatialIndex(int cellSize = 256);
+
+        void insert(T item, const QRect& rect, qint64 z);
+        void update(T item, const QRect& rect);
+        void setZ(T item, qint64 z);
+        void remove(T item);
+        void clear();
+
+        bool contains(T item) const;
+        QRect rect(T item) const;
+        qint64 z(T item) const;
+        int size() const;
+
+        QVector<T> query(const QRect& rect) const;
+        QVector<T> query(const QPoint& point) const;
+
+    private:
+        int m_cellSize;
+
+        // Dense structure-of-arrays table; cells refer to slots, and removing
+        // an item moves the last slot into the hole
+        QVector<T> m_items;
+        QVector<QRect> m_rects;
+        QVector<qint64> m_z;
+        QHash<T, int> m_slots;
+
+        QHash<quint64, QVector<int>> m_cells;
+        QSet<int> m_oversized;
+
+        QRect cellRange(const QRect& rect) const;
+        bool isOversized(const QRect& cells) const;
+        void addToCells(int slot, const QRect& cells);
+        void removeFromCells(int slot, const QRect& cells);
+
+        static int cellCoord(int value, int cellSize);
+        static quint64 cellKey(int x, int y);
+        static QPoint cellPos(quint64 key);
+};
+
+#endif
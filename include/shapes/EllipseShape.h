@@ -11,7 +11,8 @@ class EllipseShape : public Shape{
         explicit EllipseShape(const QRect& rect = QRect(), QObject* parent = nullptr);
         explicit EllipseShape(const QPoint& center, int rx, int ry, QObject* parent = nullptr);
 
-        void draw(QPainter* painter) override;
+        void drawGeometry(QPainter* painter) const override;
+        void drawSelection(QPainter* painter) const override;
         void update(const QPoint& toPoint) override;
         bool contains(const QPoint& point) const override;
         void move(const QPoint& offset) override;
@@ -21,9 +22,13 @@ class EllipseShape : public Shape{
 
         QJsonObject toJson() const override;
         void fromJson(const QJsonObject& json) override;
+        void writeBinary(BinaryWriter& out) const override;
+        void readBinary(BinaryReader& in) override;
 
+        Type type() const override;
         QString name() const override;
         QPoint position() const override;
+        Shape* clone() const override;
 
         QRect rect() const;
         void setRect(const QRect& rect);
@@ -32,12 +37,21 @@ class EllipseShape : public Shape{
         int radiusY() const;
         void setRadiusX(int rx);
         void setRadiusY(int ry);
+
+        // Tessellated outline, cached until the rect or rotation changes
+        QPolygonF rotatedPolygon() const;
  
     private:
         QRect m_rect;
+
+        mutable QPolygonF m_polygonCache;
+        mutable QRect m_polygonCacheRect;
+        mutable double m_polygonCacheAngle = 0.0;
+        mutable bool m_polygonCacheValid = false;
         
-        QPolygonF rotatedPolygon() const;
         QPointF rotationCenter() const;
+        QTransform rotationTransform() const;
+        QPolygonF handlePoints() const;
         QRect axisAlignedBoundingRect() const;
         bool isPointOnEllipse(const QPoint& point) const;
 };
@@ -12,7 +12,9 @@ class FreehandShape : public Shape{
         explicit FreehandShape(QObject* parent = nullptr);
         explicit FreehandShape(const QVector<QPoint>& points, QObject* parent = nullptr);
 
-        void draw(QPainter* painter) override;
+        void drawGeometry(QPainter* painter) const override;
+        void drawSelection(QPainter* painter) const override;
+        void prepareDraw(const QTransform& deviceTransform) const override;
         void update(const QPoint& toPoint) override;
         bool contains(const QPoint& point) const override;
         void move(const QPoint& offset) override;
@@ -22,24 +24,75 @@ class FreehandShape : public Shape{
 
         QJsonObject toJson() const override;
         void fromJson(const QJsonObject& json) override;
+        void writeBinary(BinaryWriter& out) const override;
+        void readBinary(BinaryReader& in) override;
 
+        Type type() const override;
         QString name() const override;
         QPoint position() const override;
+        Shape* clone() const override;
 
         void addPoint(const QPoint& point);
+        // Ends the stroke being drawn: the last point no longer follows new
+        // samples, and the bounds, which only grow while points are added,
+        // are recomputed
+        void finishStroke();
         void clearPoints();
         const QVector<QPoint>& points() const;
         void setPoints(const QVector<QPoint>& points);
+        // Douglas-Peucker over the whole stroke
         void simplify(double tolerance = 1.0);
 
+        // Maximum distance in pixels between a dropped sample and the stored
+        // stroke while points are added; 0 keeps every sample
+        double tolerance() const;
+        void setTolerance(double tolerance);
+
     private:
         QVector<QPoint> m_points;
         QRect m_boundingRect;
 
+        // Samples since the second to last stored point. The last stored point
+        // follows the newest sample for as long as the segment to it stays
+        // within m_tolerance of every sample in the window.
+        static const int MaxWindow = 128;
+        double m_tolerance = 0.0;
+        QVector<QPoint> m_window;
+
+        // Coarser copies of the stroke for drawing at small scales, each one
+        // simplified from the previous with twice its tolerance. A level
+        // deviates from m_points by at most its error in stroke pixels. Built
+        // on the first draw that can use them, once the stroke is finished.
+        struct Level{
+            double error;
+            QVector<QPoint> points;
+        };
+        static constexpr double LevelTolerance = 0.5;
+        static const int MaxLevels = 16;
+        mutable QVector<Level> m_levels;
+        mutable bool m_levelsValid = false;
+
+        // Two level bounds hierarchy for hit-testing: each chunk covers ChunkSize
+        // segments, each group covers ChunkSize chunks. Built lazily, extended on append.
+        static const int ChunkSize = 32;
+        mutable QVector<QRect> m_chunkBounds;
+        mutable QVector<QRect> m_groupBounds;
+        mutable bool m_chunksValid = false;
+
+        void appendPoint(const QPoint& point);
         void updateBoundingRect();
-        bool isPointNearPolyline(const QPoint& point) const;
+        bool isPointNearSegment(const QPoint& point, const QPoint& p1, const QPoint& p2) const;
+        bool windowFits(const QPoint& anchor, const QPoint& end) const;
+        const QVector<QPoint>& levelFor(const QTransform& deviceTransform) const;
+        void buildLevels() const;
+        static QVector<QPoint> douglasPeucker(const QVector<QPoint>& points, double tolerance);
+        static double squaredSegmentDistance(const QPoint& point, const QPoint& p1, const QPoint& p2);
         void applyTransform(const QTransform& transform);
         QRect axisAlignedBoundingRect() const;
+
+        void buildChunks() const;
+        void extendChunks(int index) const;
+        static QRect extendRect(const QRect& rect, const QPoint& point);
 };
 
 #endif
\ No newline at end of file
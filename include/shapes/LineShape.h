@@ -10,7 +10,8 @@ class LineShape : public Shape{
     public:
         explicit LineShape(const QPoint& startPoint = QPoint(), const QPoint& endPoint = QPoint(), QObject* parent = nullptr);
 
-        void draw(QPainter* painter) override;
+        void drawGeometry(QPainter* painter) const override;
+        void drawSelection(QPainter* painter) const override;
         void update(const QPoint& toPoint) override;
         bool contains(const QPoint& point) const override;
         void move(const QPoint& offset) override;
@@ -20,9 +21,13 @@ class LineShape : public Shape{
 
         QJsonObject toJson() const override;
         void fromJson(const QJsonObject& json) override;
+        void writeBinary(BinaryWriter& out) const override;
+        void readBinary(BinaryReader& in) override;
 
+        Type type() const override;
         QString name() const override;
         QPoint position() const override;
+        Shape* clone() const override;
 
         QPoint startPoint() const;
         QPoint endPoint() const;
@@ -35,6 +40,7 @@ class LineShape : public Shape{
         QPoint m_startPoint;
         QPoint m_endPoint;
 
+        void updateAngle();
         double distanceToLine(const QPoint& point) const;
         QPointF rotatePoint(const QPointF& point, const QPointF& center, double angle) const;
 };
@@ -12,7 +12,8 @@ class PolygonShape : public Shape
         explicit PolygonShape(QObject* parent = nullptr);
         explicit PolygonShape(const QPolygon& polygon, QObject* parent = nullptr);
 
-        void draw(QPainter* painter) override;
+        void drawGeometry(QPainter* painter) const override;
+        void drawSelection(QPainter* painter) const override;
         void update(const QPoint& toPoint) override;
         bool contains(const QPoint& point) const override;
         void move(const QPoint& offset) override;
@@ -22,9 +23,13 @@ class PolygonShape : public Shape
 
         QJsonObject toJson() const override;
         void fromJson(const QJsonObject &json) override;
+        void writeBinary(BinaryWriter& out) const override;
+        void readBinary(BinaryReader& in) override;
 
+        Type type() const override;
         QString name() const override;
         QPoint position() const override;
+        Shape* clone() const override;
 
         void addPoint(const QPoint &point);
         void closePolygon();
@@ -33,6 +38,9 @@ class PolygonShape : public Shape
         bool isClosed() const;
         int pointCount() const;
 
+    protected:
+        bool hasRoundPen() const override;
+
     private:
         QPolygon m_polygon;
         bool m_closed = false;
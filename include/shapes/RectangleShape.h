@@ -11,7 +11,9 @@ class RectangleShape : public Shape{
         explicit RectangleShape(const QRect& rect = QRect(), QObject* parent = nullptr);
         explicit RectangleShape(const QPoint& topLeft, const QPoint& bottomRight, QObject* parent = nullptr);
 
-        void draw(QPainter* painter) override;
+        void drawGeometry(QPainter* painter) const override;
+        void drawSelection(QPainter* painter) const override;
+        void prepareDraw(const QTransform& deviceTransform) const override;
         void update(const QPoint& toPoint) override;
         bool contains(const QPoint& point) const override;
         void move(const QPoint& offset) override;
@@ -21,9 +23,13 @@ class RectangleShape : public Shape{
 
         QJsonObject toJson() const override;
         void fromJson(const QJsonObject& json) override;
+        void writeBinary(BinaryWriter& out) const override;
+        void readBinary(BinaryReader& in) override;
 
+        Type type() const override;
         QString name() const override;
         QPoint position() const override;
+        Shape* clone() const override;
 
         QRect rect() const;
         void setRect(const QRect& rect);
@@ -35,7 +41,18 @@ class RectangleShape : public Shape{
     private:
         QRect m_rect;
 
+        // Rotation and rotated corners, cached until the rect or rotation changes.
+        // Checked against the geometry rather than reset by shapeChanged, which
+        // animations block.
+        mutable QTransform m_transformCache;
+        mutable QPolygonF m_polygonCache;
+        mutable QRect m_polygonCacheRect;
+        mutable double m_polygonCacheAngle = 0.0;
+        mutable bool m_polygonCacheValid = false;
+
+        void updatePolygonCache() const;
         QPolygonF rotatedPolygon() const;
+        const QTransform& rotationTransform() const;
         QPointF rotationCenter() const;
         QRect axisAlignedBoundingRect() const;
 };
@@ -11,7 +11,9 @@ class RegularPolygonShape : public Shape{
         explicit RegularPolygonShape(QObject* parent = nullptr);
         explicit RegularPolygonShape(const QPoint& center, int radius, int sides, QObject* parent = nullptr);
 
-        void draw(QPainter* painter) override;
+        void drawGeometry(QPainter* painter) const override;
+        void drawSelection(QPainter* painter) const override;
+        void prepareDraw(const QTransform& deviceTransform) const override;
         void update(const QPoint& toPoint) override;
         bool contains(const QPoint& point) const override;
         void move(const QPoint& offset) override;
@@ -21,9 +23,13 @@ class RegularPolygonShape : public Shape{
 
         QJsonObject toJson() const override;
         void fromJson(const QJsonObject &json) override;
+        void writeBinary(BinaryWriter& out) const override;
+        void readBinary(BinaryReader& in) override;
 
+        Type type() const override;
         QString name() const override;
         QPoint position() const override;
+        Shape* clone() const override;
 
         QPoint center() const;
         int radius() const;
@@ -33,12 +39,24 @@ class RegularPolygonShape : public Shape{
         void setRadius(int radius);
         void setSides(int sides);
         void setRotation(double angle);
+
+    protected:
+        bool hasRoundPen() const override;
+
     private:
         QPoint m_center;
         int m_radius;
         int m_sides;
-        
-        QPolygon createPolygon() const;
+
+        // Vertices, cached until the center, radius, sides or rotation change
+        mutable QPolygon m_polygonCache;
+        mutable QPoint m_polygonCacheCenter;
+        mutable int m_polygonCacheRadius = 0;
+        mutable int m_polygonCacheSides = 0;
+        mutable double m_polygonCacheAngle = 0.0;
+        mutable bool m_polygonCacheValid = false;
+
+        const QPolygon& polygon() const;
 };
 
 #endif
\ No newline at end of file
@@ -10,21 +10,47 @@
 
 #include <QDebug>
 
+class BinaryWriter;
+class BinaryReader;
+
 class Shape : public QObject
 {
     Q_OBJECT
 
     public:
+        // Stable values, used as record tags in the binary document format
+        enum class Type : quint8{
+            Line = 1,
+            Freehand = 2,
+            Rectangle = 3,
+            Ellipse = 4,
+            Polygon = 5,
+            RegularPolygon = 6
+        };
+
         explicit Shape(QObject* parent = nullptr);
         virtual ~Shape() = default;
 
-        virtual void draw(QPainter* painter) = 0;
+        // Pen, brush, geometry and, when selected, the selection overlay.
+        // Leaves the painter as it found it.
+        void draw(QPainter* painter) const;
+        // Outline and fill only, with whatever pen and brush the painter has.
+        // Leaves the painter's state as it found it, so runs of shapes with
+        // the same style can share one setPen()/setBrush().
+        virtual void drawGeometry(QPainter* painter) const = 0;
+        // Selection frame and handles; changes the painter's pen and brush
+        virtual void drawSelection(QPainter* painter) const = 0;
+        // Builds whatever draw() would build lazily at this device transform,
+        // so that several threads can then draw the shape at the same time
+        virtual void prepareDraw(const QTransform& deviceTransform) const;
         virtual void update(const QPoint& toPoint) = 0;
         virtual bool contains(const QPoint& point) const = 0;
+        // Relative to the current state, around the shape's center; angles in degrees
         virtual void move(const QPoint& offset);
         virtual void rotate(double angle);
         virtual void scale(double factor);
         virtual QRect boundingRect() const = 0;
+        QRect repaintRect() const;
 
         void setPenColor(const QColor& color);
         void setPenWidth(int width);
@@ -32,6 +58,11 @@ class Shape : public QObject
         void setPenStyle(Qt::PenStyle style);
         void setRotationAngle(double angle);
 
+        QPen pen() const;
+        QBrush brush() const;
+        // Whether pen() and brush() are the same for both shapes, without building them
+        bool hasSameStyle(const Shape* other) const;
+
         QColor penColor() const;
         int penWidth() const;
         QColor fillColor() const;
@@ -40,9 +71,15 @@ class Shape : public QObject
 
         virtual QJsonObject toJson() const;
         virtual void fromJson(const QJsonObject& json);
+        virtual void writeBinary(BinaryWriter& out) const;
+        virtual void readBinary(BinaryReader& in);
 
+        virtual Type type() const = 0;
         virtual QString name() const = 0;
         virtual QPoint position() const = 0;
+        // New shape with the same document state, without a parent, selection
+        // or animation. Point data is implicitly shared rather than copied.
+        virtual Shape* clone() const = 0;
 
         bool isSelected() const;
         void setSelected(bool selected);
@@ -53,6 +90,11 @@ class Shape : public QObject
         void shapeChanged();
 
     protected:
+        // Round caps and joins unless the shape draws sharp corners
+        virtual bool hasRoundPen() const;
+        // Pen, fill and rotation, for clone()
+        void copyStyleTo(Shape* copy) const;
+
         QColor m_penColor;
         int m_penWidth;
         QColor m_fillColor;
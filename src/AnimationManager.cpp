@@ -0,0 +1,232 @@
+#include "../include/AnimationManager.h"
+#include "../include/BinaryStream.h"
+#include <QSignalBlocker>
+#include <QtMath>
+#include <cmath>
+
+static QColor mixColors(const QColor& from, const QColor& to, qreal value){
+    return QColor::fromRgbF(from.redF() + (to.redF() - from.redF()) * value,
+                            from.greenF() + (to.greenF() - from.greenF()) * value,
+                            from.blueF() + (to.blueF() - from.blueF()) * value,
+                            from.alphaF() + (to.alphaF() - from.alphaF()) * value);
+}
+
+AnimationManager::AnimationManager(QObject* parent) : QObject(parent){
+    m_timer.setTimerType(Qt::PreciseTimer);
+    setFrameRate(60);
+    connect(&m_timer, &QTimer::timeout, this, &AnimationManager::tick);
+    m_clock.start();
+}
+
+void AnimationManager::animate(Shape* shape, Property property, const QVariant& to, int durationMs,
+                               Loop loop, const QEasingCurve& curve){
+    qint64 now = m_clock.elapsed();
+    QSignalBlocker blocker(shape);
+
+    auto it = m_entries.find(shape);
+    if(it == m_entries.end()){
+        it = m_entries.insert(shape, Entry());
+        it->base = snapshot(shape);
+        shape->setAnimating(true);
+    }
+    else{
+        bake(shape, *it, now, [property](const Track& track){ return track.property == property; });
+    }
+
+    Track track;
+    track.property = property;
+    track.to = to;
+    if(property == Property::PenColor)
+        track.from = shape->penColor();
+    else if(property == Property::FillColor)
+        track.from = shape->fillColor();
+    track.start = now;
+    track.duration = durationMs;
+    track.loop = loop;
+    track.curve = curve;
+    it->tracks.append(track);
+    applyTracks(shape, *it, now);
+    it->shownAt = now;
+
+    if(!m_timer.isActive())
+        m_timer.start();
+}
+
+void AnimationManager::stop(Shape* shape){
+    auto it = m_entries.find(shape);
+    if(it == m_entries.end())
+        return;
+
+    {
+        QSignalBlocker blocker(shape);
+        bake(shape, *it, it->shownAt, [](const Track&){ return true; });
+        shape->setAnimating(false);
+    }
+    m_entries.erase(it);
+    if(m_entries.isEmpty())
+        m_timer.stop();
+
+    emit frameAdvanced({shape});
+    emit finished(shape);
+}
+
+void AnimationManager::stopAll(){
+    const QList<Shape*> shapes = m_entries.keys();
+    for(Shape* shape : shapes)
+        stop(shape);
+}
+
+void AnimationManager::forget(Shape* shape){
+    auto it = m_entries.find(shape);
+    if(it == m_entries.end())
+        return;
+
+    {
+        QSignalBlocker blocker(shape);
+        restore(shape, it->base);
+        shape->setAnimating(false);
+    }
+    m_entries.erase(it);
+    if(m_entries.isEmpty())
+        m_timer.stop();
+}
+
+void AnimationManager::clear(){
+    m_entries.clear();
+    m_timer.stop();
+}
+
+bool AnimationManager::isAnimating(Shape* shape) const{
+    return m_entries.contains(shape);
+}
+
+int AnimationManager::count() const{
+    return m_entries.size();
+}
+
+void AnimationManager::setFrameRate(qreal framesPerSecond){
+    if(framesPerSecond <= 0)
+        framesPerSecond = 60;
+    m_timer.setInterval(qMax(1, qRound(1000.0 / framesPerSecond)));
+}
+
+void AnimationManager::tick(){
+    // Every shape is evaluated at the same frame time
+    qint64 now = m_clock.elapsed();
+
+    QVector<Shape*> shapes;
+    QVector<Shape*> done;
+    shapes.reserve(m_entries.size());
+    for(auto it = m_entries.begin(); it != m_entries.end(); ++it){
+        Shape* shape = it.key();
+        QSignalBlocker blocker(shape);
+        bake(shape, *it, now, [this, now](const Track& track){ return isDone(track, now); });
+        applyTracks(shape, *it, now);
+        it->shownAt = now;
+        if(it->tracks.isEmpty()){
+            shape->setAnimating(false);
+            done.append(shape);
+        }
+        shapes.append(shape);
+    }
+
+    for(Shape* shape : done)
+        m_entries.remove(shape);
+    if(m_entries.isEmpty())
+        m_timer.stop();
+
+    emit frameAdvanced(shapes);
+    for(Shape* shape : done)
+        emit finished(shape);
+}
+
+// Restores the base state and folds the selected tracks, at their value for
+// now, into a new base. The remaining tracks still need applyTracks().
+void AnimationManager::bake(Shape* shape, Entry& entry, qint64 now, const std::function<bool(const Track&)>& which){
+    restore(shape, entry.base);
+
+    bool baked = false;
+    for(int i = 0; i < entry.tracks.size(); ){
+        if(which(entry.tracks[i])){
+            applyTrack(shape, entry.tracks[i], progress(entry.tracks[i], now));
+            entry.tracks.remove(i);
+            baked = true;
+        }
+        else{
+            ++i;
+        }
+    }
+    if(baked)
+        entry.base = snapshot(shape);
+}
+
+void AnimationManager::applyTracks(Shape* shape, const Entry& entry, qint64 now) const{
+    for(const Track& track : entry.tracks)
+        applyTrack(shape, track, progress(track, now));
+}
+
+void AnimationManager::applyTrack(Shape* shape, const Track& track, qreal value) const{
+    switch(track.property){
+        case Property::Rotation:{
+            double angle = track.to.toDouble() * value;
+            if(!qFuzzyIsNull(angle))
+                shape->rotate(angle);
+            break;
+        }
+        case Property::Scale:{
+            double factor = 1.0 + (track.to.toDouble() - 1.0) * value;
+            if(!qFuzzyCompare(factor, 1.0))
+                shape->scale(factor);
+            break;
+        }
+        case Property::Offset:{
+            QPoint offset = (QPointF(track.to.toPoint()) * value).toPoint();
+            if(!offset.isNull())
+                shape->move(offset);
+            break;
+        }
+        case Property::PenColor:
+            shape->setPenColor(mixColors(track.from, track.to.value<QColor>(), value));
+            break;
+        case Property::FillColor:
+            shape->setFillColor(mixColors(track.from, track.to.value<QColor>(), value));
+            break;
+    }
+}
+
+qreal AnimationManager::progress(const Track& track, qint64 now) const{
+    if(track.duration <= 0)
+        return track.curve.valueForProgress(1.0);
+
+    qreal t = qreal(now - track.start) / track.duration;
+    switch(track.loop){
+        case Loop::Once:
+            t = qMin(t, qreal(1.0));
+            break;
+        case Loop::Repeat:
+            t -= qFloor(t);
+            break;
+        case Loop::PingPong:
+            t = std::fmod(t, qreal(2.0));
+            if(t > 1.0)
+                t = 2.0 - t;
+            break;
+    }
+    return track.curve.valueForProgress(t);
+}
+
+bool AnimationManager::isDone(const Track& track, qint64 now) const{
+    return track.loop == Loop::Once && now - track.start >= track.duration;
+}
+
+QByteArray AnimationManager::snapshot(const Shape* shape){
+    QByteArray state;
+    BinaryWriter out(&state);
+    shape->writeBinary(out);
+    return state;
+}
+
+void AnimationManager::restore(Shape* shape, const QByteArray& state){
+    BinaryReader in(state.constData(), state.size());
+    shape->readBinary(in);
+}
@@ -0,0 +1,203 @@
+#include "../include/BinaryStream.h"
+#include <QtEndian>
+#include <cstring>
+
+BinaryWriter::BinaryWriter(QByteArray* buffer) : m_buffer(buffer) {}
+
+void BinaryWriter::writeByte(quint8 value){
+    m_buffer->append(char(value));
+}
+
+void BinaryWriter::writeUInt16(quint16 value){
+    char bytes[2];
+    qToLittleEndian(value, bytes);
+    m_buffer->append(bytes, 2);
+}
+
+void BinaryWriter::writeUInt32(quint32 value){
+    char bytes[4];
+    qToLittleEndian(value, bytes);
+    m_buffer->append(bytes, 4);
+}
+
+void BinaryWriter::writeVarint(quint64 value){
+    char bytes[10];
+    int length = 0;
+    while(value >= 0x80){
+        bytes[length++] = char((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    bytes[length++] = char(value);
+    m_buffer->append(bytes, length);
+}
+
+void BinaryWriter::writeSVarint(qint64 value){
+    writeVarint((quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+void BinaryWriter::writeDouble(double value){
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    char bytes[8];
+    qToLittleEndian(bits, bytes);
+    m_buffer->append(bytes, 8);
+}
+
+void BinaryWriter::writeColor(const QColor& color){
+    writeUInt32(color.rgba());
+}
+
+void BinaryWriter::writePoint(const QPoint& point){
+    writeSVarint(point.x());
+    writeSVarint(point.y());
+}
+
+void BinaryWriter::writeRect(const QRect& rect){
+    writeSVarint(rect.x());
+    writeSVarint(rect.y());
+    writeSVarint(rect.width());
+    writeSVarint(rect.height());
+}
+
+void BinaryWriter::writePoints(const QVector<QPoint>& points){
+    writeVarint(points.size());
+    QPoint previous;
+    for(const QPoint& p : points){
+        writePoint(p - previous);
+        previous = p;
+    }
+}
+
+void BinaryWriter::writeBytes(const QByteArray& bytes){
+    m_buffer->append(bytes);
+}
+
+BinaryReader::BinaryReader(const char* data, qint64 size) : m_data(data), m_size(size) {}
+
+bool BinaryReader::atEnd() const{
+    return m_pos >= m_size;
+}
+
+bool BinaryReader::hasError() const{
+    return m_error;
+}
+
+qint64 BinaryReader::position() const{
+    return m_pos;
+}
+
+qint64 BinaryReader::remaining() const{
+    return m_size - m_pos;
+}
+
+const char* BinaryReader::current() const{
+    return m_data + m_pos;
+}
+
+bool BinaryReader::require(qint64 length){
+    if(m_error || length < 0 || m_size - m_pos < length){
+        m_error = true;
+        return false;
+    }
+    return true;
+}
+
+quint8 BinaryReader::readByte(){
+    if(!require(1))
+        return 0;
+    return quint8(m_data[m_pos++]);
+}
+
+quint16 BinaryReader::readUInt16(){
+    if(!require(2))
+        return 0;
+    quint16 value = qFromLittleEndian<quint16>(m_data + m_pos);
+    m_pos += 2;
+    return value;
+}
+
+quint32 BinaryReader::readUInt32(){
+    if(!require(4))
+        return 0;
+    quint32 value = qFromLittleEndian<quint32>(m_data + m_pos);
+    m_pos += 4;
+    return value;
+}
+
+quint64 BinaryReader::readVarint(){
+    quint64 value = 0;
+    for(int shift = 0; shift < 64; shift += 7){
+        if(!require(1))
+            return 0;
+        quint8 byte = quint8(m_data[m_pos++]);
+        value |= quint64(byte & 0x7f) << shift;
+        if(!(byte & 0x80))
+            return value;
+    }
+    m_error = true;
+    return 0;
+}
+
+qint64 BinaryReader::readSVarint(){
+    quint64 value = readVarint();
+    return qint64(value >> 1) ^ -qint64(value & 1);
+}
+
+double BinaryReader::readDouble(){
+    if(!require(8))
+        return 0.0;
+    quint64 bits = qFromLittleEndian<quint64>(m_data + m_pos);
+    m_pos += 8;
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+QColor BinaryReader::readColor(){
+    return QColor::fromRgba(readUInt32());
+}
+
+QPoint BinaryReader::readPoint(){
+    int x = int(readSVarint());
+    int y = int(readSVarint());
+    return QPoint(x, y);
+}
+
+QRect BinaryReader::readRect(){
+    int x = int(readSVarint());
+    int y = int(readSVarint());
+    int width = int(readSVarint());
+    int height = int(readSVarint());
+    return QRect(x, y, width, height);
+}
+
+QVector<QPoint> BinaryReader::readPoints(){
+    QVector<QPoint> points;
+    quint64 count = readVarint();
+    // Every point takes at least two bytes, anything larger is corrupt
+    if(m_error || count > quint64(remaining() / 2)){
+        m_error = true;
+        return points;
+    }
+
+    points.reserve(int(count));
+    QPoint previous;
+    for(quint64 i = 0; i < count && !m_error; ++i){
+        previous += readPoint();
+        points.append(previous);
+    }
+    return points;
+}
+
+BinaryReader BinaryReader::subReader(qint64 length){
+    if(!require(length))
+        return BinaryReader(m_data + m_pos, 0);
+    BinaryReader reader(m_data + m_pos, length);
+    m_pos += length;
+    return reader;
+}
+
+void BinaryReader::skip(qint64 length){
+    if(require(length))
+        m_pos += length;
+}
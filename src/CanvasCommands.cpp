@@ -0,0 +1,145 @@
+#include "../include/CanvasCommands.h"
+#include "../include/CanvasWidget.h"
+
+enum CommandId{
+    MoveShapeId = 1,
+    ShapePropertyId
+};
+
+AddShapesCommand::AddShapesCommand(CanvasWidget* canvas, const QVector<Shape*>& shapes, const QVector<qint64>& z,
+                                   const QString& text, QUndoCommand* parent)
+    : QUndoCommand(text, parent), m_canvas(canvas), m_shapes(shapes), m_z(z){
+}
+
+AddShapesCommand::~AddShapesCommand(){
+    if(!m_inDocument)
+        qDeleteAll(m_shapes);
+}
+
+void AddShapesCommand::undo(){
+    m_canvas->removeShapes(m_shapes);
+    m_inDocument = false;
+}
+
+void AddShapesCommand::redo(){
+    m_canvas->addShapes(m_shapes, m_z);
+    m_inDocument = true;
+}
+
+RemoveShapesCommand::RemoveShapesCommand(CanvasWidget* canvas, const QVector<Shape*>& shapes,
+                                         const QString& text, QUndoCommand* parent)
+    : QUndoCommand(text, parent), m_canvas(canvas), m_shapes(shapes){
+    m_z.reserve(shapes.size());
+    for(Shape* shape : shapes)
+        m_z.append(canvas->shapeZ(shape));
+}
+
+RemoveShapesCommand::~RemoveShapesCommand(){
+    if(!m_inDocument)
+        qDeleteAll(m_shapes);
+}
+
+void RemoveShapesCommand::undo(){
+    m_canvas->addShapes(m_shapes, m_z);
+    m_inDocument = true;
+}
+
+void RemoveShapesCommand::redo(){
+    m_canvas->removeShapes(m_shapes);
+    m_inDocument = false;
+}
+
+ZOrderCommand::ZOrderCommand(CanvasWidget* canvas, Shape* shape, qint64 z, const QString& text, QUndoCommand* parent)
+    : QUndoCommand(text, parent), m_canvas(canvas), m_shape(shape), m_oldZ(canvas->shapeZ(shape)), m_newZ(z){
+}
+
+void ZOrderCommand::undo(){
+    m_canvas->setShapeZ(m_shape, m_oldZ);
+}
+
+void ZOrderCommand::redo(){
+    m_canvas->setShapeZ(m_shape, m_newZ);
+}
+
+MoveShapeCommand::MoveShapeCommand(CanvasWidget* canvas, Shape* shape, const QPoint& offset, QUndoCommand* parent)
+    : QUndoCommand("Move " + shape->name(), parent), m_canvas(canvas), m_shape(shape), m_offset(offset){
+}
+
+void MoveShapeCommand::undo(){
+    m_canvas->animations()->stop(m_shape);
+    m_shape->move(-m_offset);
+}
+
+void MoveShapeCommand::redo(){
+    m_canvas->animations()->stop(m_shape);
+    m_shape->move(m_offset);
+}
+
+int MoveShapeCommand::id() const{
+    return MoveShapeId;
+}
+
+bool MoveShapeCommand::mergeWith(const QUndoCommand* other){
+    const MoveShapeCommand* move = static_cast<const MoveShapeCommand*>(other);
+    if(move->m_shape != m_shape)
+        return false;
+    m_offset += move->m_offset;
+    setObsolete(m_offset.isNull());
+    return true;
+}
+
+ShapePropertyCommand::ShapePropertyCommand(CanvasWidget* canvas, Shape* shape, Property property, const QVariant& value,
+                                           QUndoCommand* parent)
+    : QUndoCommand("Change " + shape->name(), parent), m_canvas(canvas), m_shape(shape), m_property(property),
+      m_oldValue(read(shape, property)), m_newValue(value){
+}
+
+void ShapePropertyCommand::undo(){
+    m_canvas->animations()->stop(m_shape);
+    write(m_shape, m_property, m_oldValue);
+}
+
+void ShapePropertyCommand::redo(){
+    m_canvas->animations()->stop(m_shape);
+    write(m_shape, m_property, m_newValue);
+    setObsolete(m_oldValue == m_newValue);
+}
+
+int ShapePropertyCommand::id() const{
+    return ShapePropertyId;
+}
+
+bool ShapePropertyCommand::mergeWith(const QUndoCommand* other){
+    const ShapePropertyCommand* edit = static_cast<const ShapePropertyCommand*>(other);
+    if(edit->m_shape != m_shape || edit->m_property != m_property)
+        return false;
+    m_newValue = edit->m_newValue;
+    setObsolete(m_oldValue == m_newValue);
+    return true;
+}
+
+QVariant ShapePropertyCommand::read(const Shape* shape, Property property){
+    switch(property){
+        case Property::PenColor:
+            return shape->penColor();
+        case Property::PenWidth:
+            return shape->penWidth();
+        case Property::FillColor:
+            return shape->fillColor();
+    }
+    return QVariant();
+}
+
+void ShapePropertyCommand::write(Shape* shape, Property property, const QVariant& value){
+    switch(property){
+        case Property::PenColor:
+            shape->setPenColor(value.value<QColor>());
+            break;
+        case Property::PenWidth:
+            shape->setPenWidth(value.toInt());
+            break;
+        case Property::FillColor:
+            shape->setFillColor(value.value<QColor>());
+            break;
+    }
+}
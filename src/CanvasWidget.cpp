@@ -1,4 +1,8 @@
 #include "../include/CanvasWidget.h"
+#include "../include/DocumentIO.h"
+#include "../include/DocumentLoader.h"
+#include "../include/DocumentRenderer.h"
+#include "../include/CanvasCommands.h"
 #include "../include/shapes/LineShape.h"
 #include "../include/shapes/FreehandShape.h"
 #include "../include/shapes/RectangleShape.h"
@@ -7,11 +11,22 @@
 #include "../include/shapes/RegularPolygonShape.h"
 #include <QPainter>
 #include <QMouseEvent>
-#include <QFile>
-#include <QJsonDocument>
-#include <QJsonArray>
-#include <QMessageBox>
+#include <QKeyEvent>
+#include <QWheelEvent>
+#include <QNativeGestureEvent>
+#include <QGesture>
 #include <QMenu>
+#include <QProgressDialog>
+#include <QEventLoop>
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QScreen>
+#include <QSet>
+#include <QtMath>
+#include <algorithm>
+
+constexpr qreal CanvasWidget::MinZoom;
+constexpr qreal CanvasWidget::MaxZoom;
 
 CanvasWidget::CanvasWidget(QWidget* parent) : QWidget(parent){
     setMouseTracking(true);
@@ -19,6 +34,36 @@ CanvasWidget::CanvasWidget(QWidget* parent) : QWidget(parent){
     setAttribute(Qt::WA_OpaquePaintEvent);
     setAutoFillBackground(true);
     setMinimumSize(400, 300);
+    grabGesture(Qt::PinchGesture);
+
+    if(QScreen* display = screen())
+        m_animations.setFrameRate(display->refreshRate());
+    connect(&m_animations, &AnimationManager::frameAdvanced, this, &CanvasWidget::handleAnimationFrame);
+    connect(&m_animations, &AnimationManager::finished, this, &CanvasWidget::handleAnimationFinished);
+    connect(&m_undoStack, &QUndoStack::cleanChanged, this, [this](bool clean){
+        m_isModified = !clean;
+        emit fileModified(!clean);
+    });
+    connect(&m_undoStack, &QUndoStack::indexChanged, this, [this](){ ++m_historySteps; });
+    connect(&m_saver, &DocumentSaver::finished, this, &CanvasWidget::handleSaveFinished);
+
+    m_journalTimer.setSingleShot(true);
+    m_journalTimer.setInterval(JournalDelay);
+    connect(&m_journalTimer, &QTimer::timeout, this, &CanvasWidget::flushJournal);
+
+#ifdef PAINT_INSTRUMENTATION
+    m_hudTimer.setInterval(250);
+    connect(&m_hudTimer, &QTimer::timeout, this, [this](){ update(m_stats.hudRect()); });
+#endif
+}
+
+CanvasWidget::~CanvasWidget(){
+    // Shapes are owned by the canvas explicitly, not through QObject parenting
+    qDeleteAll(m_shapes);
+    qDeleteAll(m_pendingRects.keys());
+    // The journal is the only copy of edits a save did not get onto disk
+    if(m_saver.waitForFinished() && !m_isModified)
+        m_journal.discard();
 }
 
 QColor CanvasWidget::penColor(){
@@ -39,55 +84,85 @@ void CanvasWidget::setCurrentShapeType(const QString& shapeType){
 
 void CanvasWidget::setPenColor(const QColor& color){
     m_penColor = color;
-    if(m_currentShape){
+    if(m_currentShape && m_index.contains(m_currentShape)){
+        m_undoStack.push(new ShapePropertyCommand(this, m_currentShape, ShapePropertyCommand::Property::PenColor, color));
+    }
+    else if(m_currentShape){
         m_currentShape->setPenColor(color);
-        update();
     }
 }
 
 void CanvasWidget::setPenWidth(int width){
     m_penWidth = width;
-    if(m_currentShape){
+    if(m_currentShape && m_index.contains(m_currentShape)){
+        m_undoStack.push(new ShapePropertyCommand(this, m_currentShape, ShapePropertyCommand::Property::PenWidth, width));
+    }
+    else if(m_currentShape){
         m_currentShape->setPenWidth(width);
-        update();
     }
 }
 
 void CanvasWidget::setFillColor(const QColor& color){
     m_fillColor = color;
-    if(m_currentShape){
+    if(m_currentShape && m_index.contains(m_currentShape)){
+        m_undoStack.push(new ShapePropertyCommand(this, m_currentShape, ShapePropertyCommand::Property::FillColor, color));
+    }
+    else if(m_currentShape){
         m_currentShape->setFillColor(color);
-        update();
     }
 }
 
-void CanvasWidget::paintEvent(QPaintEvent* event){
-    Q_UNUSED(event);
+double CanvasWidget::strokeTolerance() const{
+    return m_strokeTolerance;
+}
 
-    qDebug() << "Paint event";
+void CanvasWidget::setStrokeTolerance(double tolerance){
+    m_strokeTolerance = qMax(0.0, tolerance);
+}
 
-    QPainter painter(this);
-    painter.fillRect(rect(), Qt::white);
+void CanvasWidget::paintEvent(QPaintEvent* event){
+    const QRegion& dirty = event->region();
 
+    // Timer refreshes of the HUD alone are not recorded as frames
+    PAINT_STATS(bool record = !m_stats.isHudVisible() || !m_stats.hudRect().contains(dirty.boundingRect()));
+    PAINT_STATS(if(record) m_stats.beginFrame());
 
-    qDebug() << m_shapes.size();
-    for(Shape* shape : m_shapes){
-        qDebug() << "Paint event shape";
-        shape->draw(&painter);
-    }
+    updateStaticLayer();
+
+    QPainter painter(this);
+    painter.setClipRegion(dirty);
+    painter.drawImage(QPoint(0, 0), m_staticLayer);
 
     if(m_currentShape && m_isDrawing){
-        m_currentShape->draw(&painter);
+        PAINT_STATS(m_stats.addVisited(1));
+        if(dirty.intersects(toView(m_pendingRects.value(m_currentShape)))){
+            painter.save();
+            painter.setTransform(viewTransform());
+            m_currentShape->draw(&painter);
+            painter.restore();
+            PAINT_STATS(m_stats.addDrawn(1));
+        }
     }
+
+    PAINT_STATS(if(record) m_stats.endFrame());
+    PAINT_STATS(if(m_stats.isHudVisible()) m_stats.drawHud(&painter));
 }
 
 
 void CanvasWidget::mousePressEvent(QMouseEvent *event)
 {
+    PAINT_STATS(m_stats.markInput());
     qDebug() << "Mouse press" << m_currentShapeType;
 
+    if(event->button() == Qt::MiddleButton){
+        m_panning = true;
+        m_lastMousePos = event->pos();
+        setCursor(Qt::ClosedHandCursor);
+        return;
+    }
+
     if(event->button() == Qt::LeftButton){
-        m_lastPoint = event->pos();
+        m_lastPoint = toDocument(event->pos());
         
         if(m_currentShapeType == "Freehand"){
             m_currentShape = createShape(m_currentShapeType);
@@ -104,53 +179,66 @@ void CanvasWidget::mousePressEvent(QMouseEvent *event)
             if (PolygonShape* polygon = qobject_cast<PolygonShape*>(m_currentShape)) {
                 polygon->addPoint(m_lastPoint);
             }
-            update();
         }
         else {
             m_currentShape = createShape(m_currentShapeType);
             qDebug() << "Shape created" << (m_currentShape == nullptr);
             m_isDrawing = true;
         }
-        
-        m_isModified = true;
-        emit fileModified(true);
     }
     else if (event->button() == Qt::RightButton) {
-        selectShape(event->pos());
+        selectShape(toDocument(event->pos()));
     }
 }
 
 void CanvasWidget::mouseMoveEvent(QMouseEvent *event){
+    if(m_panning){
+        panBy(event->pos() - m_lastMousePos);
+        m_lastMousePos = event->pos();
+        return;
+    }
 
     if ((event->buttons() & Qt::LeftButton) && m_isDrawing && m_currentShape) {
+        PAINT_STATS(m_stats.markInput());
         if (m_currentShapeType == "Freehand") {
             if (FreehandShape* freehand = qobject_cast<FreehandShape*>(m_currentShape)) {
-                freehand->addPoint(event->pos());
+                freehand->addPoint(toDocument(event->pos()));
             }
         } else {
             if(m_currentShapeType != "Polygon"){
-                m_currentShape->update(event->pos());
+                m_currentShape->update(toDocument(event->pos()));
             }
         }
-        update();
     }
 }
 
 void CanvasWidget::mouseReleaseEvent(QMouseEvent *event)
 {
+    PAINT_STATS(m_stats.markInput());
     qDebug() << "Mouse release";
 
+    if(event->button() == Qt::MiddleButton && m_panning){
+        m_panning = false;
+        unsetCursor();
+        return;
+    }
+
     if (event->button() == Qt::LeftButton && m_isDrawing && m_currentShape) {
         if (m_currentShapeType == "Freehand") {
-            m_shapes.append(m_currentShape);
+            if (FreehandShape* freehand = qobject_cast<FreehandShape*>(m_currentShape)) {
+                freehand->finishStroke();
+            }
+            commitShape(m_currentShape);
             m_currentShape = nullptr;
         }
         else if (m_currentShapeType != "Polygon") {
-            m_shapes.append(m_currentShape);
+            commitShape(m_currentShape);
             m_currentShape = nullptr;
         }
+        else {
+            updateDocument(m_pendingRects.value(m_currentShape));
+        }
         m_isDrawing = false;
-        update();
     }
 }
 
@@ -163,22 +251,22 @@ void CanvasWidget::mouseDoubleClickEvent(QMouseEvent *event)
         PolygonShape* polygon = qobject_cast<PolygonShape*>(m_currentShape);
         if (polygon) {
             polygon->closePolygon();
-            m_shapes.append(m_currentShape);
+            commitShape(m_currentShape);
             m_currentShape = nullptr;
             m_isDrawing = false;
-            update();
         }
     }
 }
 
 void CanvasWidget::contextMenuEvent(QContextMenuEvent* event){
-    selectShape(event->pos());
+    selectShape(toDocument(event->pos()));
     if(!m_currentShape)
         return;
     
     QMenu menu(this);
     QAction* deleteAction = menu.addAction("Delete");
-    QAction* animateAction = menu.addAction("Animate");
+    bool animating = m_animations.isAnimating(m_currentShape);
+    QAction* animateAction = menu.addAction(animating ? "Stop animation" : "Animate");
     QAction* bringToFrontAction = menu.addAction("Bring to front");
     QAction* sendToBackAction = menu.addAction("Send to back");
 
@@ -188,7 +276,10 @@ void CanvasWidget::contextMenuEvent(QContextMenuEvent* event){
     }
     else{
         if(selectedAction == animateAction){
-            startAnimation();
+            if(animating)
+                stopAnimation();
+            else
+                startAnimation();
         }
         else{
             if(selectedAction == bringToFrontAction){
@@ -209,27 +300,29 @@ Shape* CanvasWidget::createShape(const QString& shapeType){
     qDebug() << "Shape creating" << shapeType << (shape == nullptr);
 
     if(shapeType == "Line"){
-        shape = new LineShape(m_lastPoint, m_lastPoint, this);
+        shape = new LineShape(m_lastPoint, m_lastPoint);
     }
     else{
         if(shapeType == "Freehand"){
-            shape = new FreehandShape(this);
+            FreehandShape* freehand = new FreehandShape();
+            freehand->setTolerance(m_strokeTolerance);
+            shape = freehand;
         }
         else{
             if(shapeType == "Rectangle"){
-                shape = new RectangleShape(m_lastPoint, m_lastPoint, this);
+                shape = new RectangleShape(m_lastPoint, m_lastPoint);
             }
             else{
                 if(shapeType == "Ellipse"){
-                    shape = new EllipseShape(m_lastPoint, 0, 0, this);
+                    shape = new EllipseShape(m_lastPoint, 0, 0);
                 }
                 else{
                     if(shapeType == "Polygon"){
-                        shape = new PolygonShape(this);
+                        shape = new PolygonShape();
                     }
                     else{
                         if(shapeType == "RegularPolygon"){
-                            shape = new RegularPolygonShape(m_lastPoint, 0, 5, this);
+                            shape = new RegularPolygonShape(m_lastPoint, 0, 5);
                         }
                     }
                 }
@@ -242,154 +335,794 @@ Shape* CanvasWidget::createShape(const QString& shapeType){
         shape->setPenColor(m_penColor);
         shape->setPenWidth(m_penWidth);
         shape->setFillColor(m_fillColor);
+        trackShape(shape);
     }
 
     return shape;
 }
 
 void CanvasWidget::selectShape(const QPoint& point){
-    for(Shape* shape : m_shapes){
-        shape->setSelected(false);
+    PAINT_STATS(qint64 selectStart = m_stats.now());
+
+    if(m_selectedShape){
+        m_selectedShape->setSelected(false);
+        m_selectedShape = nullptr;
     }
 
     m_currentShape = nullptr;
-    for(int i = m_shapes.size() - 1; i >= 0; --i){
-        if(m_shapes[i]->contains(point)){
-            m_shapes[i]->setSelected(true);
-            m_currentShape = m_shapes[i];
+    materialize(QRect(point, QSize(1, 1)));
+    const QVector<Shape*> candidates = m_index.query(point);
+    for(int i = candidates.size() - 1; i >= 0; --i){
+        if(candidates[i]->contains(point)){
+            candidates[i]->setSelected(true);
+            m_currentShape = candidates[i];
+            m_selectedShape = m_currentShape;
             emit shapeSelected(m_currentShape->name() + " selected");
             break;
         }
     }
 
-    update();
+    PAINT_STATS(m_stats.recordSelection(selectStart, candidates.size()));
 }
 
 bool CanvasWidget::saveToFile(const QString& filename){
-    QJsonArray shapesArray;
-    for(Shape* shape : m_shapes){
-        shapesArray.append(shape->toJson());
-    }
+#ifdef Q_OS_WIN
+    // Windows cannot replace a file that is still mapped
+    if(m_lazyDocument && QFileInfo(m_lazyDocument->fileName()) == QFileInfo(filename))
+        materializeAll();
+#endif
 
-    QJsonDocument doc(shapesArray);
-    QFile file(filename);
-    if(!file.open(QIODevice::WriteOnly)){
+    // Encoding and writing happen on the saver's thread, edits made meanwhile
+    // only touch the live shapes. The journal position marks which of its
+    // entries the saved file will contain. The document stays modified until
+    // the file is written.
+    flushJournal();
+    PendingSave save{filename, {}, m_journal.position(), m_historySteps, true};
+    if(!m_saver.start(takeSnapshot(save.slots, DocumentIO::formatForFile(filename)), filename))
         return false;
+    m_pendingSaves.append(save);
+    return true;
+}
+
+bool CanvasWidget::loadCancelled() const{
+    return m_loadCancelled;
+}
+
+bool CanvasWidget::waitForSave(){
+    if(m_pendingSaves.isEmpty())
+        return true;
+    bool ok = m_saver.waitForFinished();
+    // finished() is queued; delivering it now updates the clean state before returning
+    QCoreApplication::sendPostedEvents(&m_saver, QEvent::MetaCall);
+    return ok;
+}
+
+// Merges committed shapes and not yet decoded records in z order. Unchanged
+// shapes reuse their cached record; the others are copied and encoded on the
+// saver's thread. A JSON file is written from shape state, so every shape is
+// copied for it.
+DocumentSnapshot CanvasWidget::takeSnapshot(QVector<DocumentJournal::Slot>& slots, DocumentIO::Format format){
+    DocumentSnapshot snapshot;
+    QVector<int> pending;
+    if(m_lazyDocument){
+        pending = m_lazyDocument->pendingRecords();
+        snapshot.source = m_lazyDocument;
     }
 
-    file.write(doc.toJson());
-    file.close();
-    m_isModified = false;
-    emit fileModified(false);
-    return true;
+    // Not yet decoded records keep the id and z they get when decoded
+    auto appendPending = [&](int record){
+        DocumentSnapshot::Item item;
+        item.record = m_lazyDocument->record(record);
+        snapshot.items.append(item);
+        slots.append({quint64(record) + 1, qint64(record) + 1});
+    };
+
+    snapshot.items.reserve(m_shapes.size() + pending.size());
+    slots.reserve(m_shapes.size() + pending.size());
+    auto next = pending.cbegin();
+    for(Shape* shape : m_shapes){
+        qint64 z = m_index.z(shape);
+        for(; next != pending.cend() && *next + 1 < z; ++next)
+            appendPending(*next);
+
+        DocumentSnapshot::Item item;
+        auto cached = m_recordCache.constFind(shape);
+        if(format == DocumentIO::Format::Binary && cached != m_recordCache.cend()){
+            item.record = *cached;
+        }
+        else{
+            item.shape.reset(shape->clone());
+            // Used and deleted on the saver's thread
+            item.shape->moveToThread(nullptr);
+        }
+        snapshot.items.append(item);
+        slots.append({journalId(shape), z});
+    }
+    for(; next != pending.cend(); ++next)
+        appendPending(*next);
+    return snapshot;
+}
+
+const DocumentIO::Record& CanvasWidget::cachedRecord(Shape* shape){
+    auto it = m_recordCache.find(shape);
+    if(it == m_recordCache.end())
+        it = m_recordCache.insert(shape, DocumentIO::encodeRecord(shape));
+    return *it;
 }
 
 bool CanvasWidget::loadFromFile(const QString& filename){
-    QFile file(filename);
-    if(!file.open(QIODevice::ReadOnly)){
-        return false;
-    }
+    m_loadCancelled = false;
+    if(DocumentIO::formatForFile(filename) == DocumentIO::Format::Binary){
+        // Only the record table is read now, shapes are decoded as they get painted or hit
+        LazyDocument* document = LazyDocument::open(filename);
+        if(!document){
+            return false;
+        }
 
-    QByteArray data = file.readAll();
-    QJsonDocument doc = QJsonDocument::fromJson(data);
-    if(!doc.isArray()){
-        return false;
+        resetDocument();
+        m_lazyDocument.reset(document);
+        m_topZ = document->recordCount();
+        m_nextJournalId = quint64(m_topZ) + 1;
     }
+    else{
+        // Shapes are parsed on a thread pool while a local event loop keeps the window alive.
+        // The dialog is up before the loop runs, so no input or close request can reach
+        // the canvas while the old document is still in place.
+        DocumentLoader loader;
+        QProgressDialog progress("Loading " + QFileInfo(filename).fileName() + "...", "Cancel", 0, 0, this);
+        progress.setWindowModality(Qt::ApplicationModal);
+        progress.setMinimumDuration(0);
+        progress.show();
 
-    clearCanvas();
+        QEventLoop loop;
+        bool ok = false;
+        connect(&loader, &DocumentLoader::progress, &progress, [&progress](int done, int total){
+            progress.setMaximum(total);
+            progress.setValue(done);
+        });
+        connect(&progress, &QProgressDialog::canceled, &loader, &DocumentLoader::cancel);
+        connect(&loader, &DocumentLoader::finished, &loop, [&loop, &ok](bool result){
+            ok = result;
+            loop.quit();
+        });
+        loader.start(filename);
+        loop.exec();
+        if(!ok){
+            m_loadCancelled = progress.wasCanceled();
+            return false;
+        }
 
-    QJsonArray shapesArray = doc.array();
-    for(const QJsonValue& value : shapesArray){
-        QJsonObject shapeObject = value.toObject();
-        if(shapeObject.contains("type")){
-            QString type = shapeObject["type"].toString();
-            Shape* shape = createShape(type);
-            if(shape){
-                shape->fromJson(shapeObject);   
-                m_shapes.append(shape);
-            }
+        resetDocument();
+
+        // Shapes arrive in document order, the full invalidation below repaints them
+        for(Shape* shape : loader.takeShapes()){
+            connect(shape, &Shape::shapeChanged, this, &CanvasWidget::handleShapeChanged);
+            insertShape(shape, ++m_topZ);
+            m_journalIds.insert(shape, quint64(m_topZ));
         }
+        m_nextJournalId = quint64(m_topZ) + 1;
     }
 
+    m_journal.setDocument(filename);
     m_isModified = false;
     emit fileModified(false);
-    update();
+    invalidateView();
+    return true;
+}
+
+bool CanvasWidget::recoverFile(const QString& filename){
+    m_loadCancelled = false;
+    QVector<DocumentJournal::Entry> entries;
+    if(!DocumentJournal::replay(filename, entries)){
+        return false;
+    }
+
+    resetDocument();
+    for(const DocumentJournal::Entry& entry : entries){
+        Shape* shape = DocumentIO::decodeRecord(entry.record);
+        if(!shape)
+            continue;
+        connect(shape, &Shape::shapeChanged, this, &CanvasWidget::handleShapeChanged);
+        insertShape(shape, entry.z);
+        m_journalIds.insert(shape, entry.id);
+        m_recordCache.insert(shape, entry.record);
+        m_topZ = qMax(m_topZ, entry.z);
+        m_bottomZ = qMin(m_bottomZ, entry.z);
+        m_nextJournalId = qMax(m_nextJournalId, entry.id + 1);
+    }
+
+    // Further edits go on top of the recovered ones until the next save compacts them
+    m_journal.resume(filename);
+    m_undoStack.resetClean();
+    invalidateView();
     return true;
 }
 
+void CanvasWidget::newDocument(){
+    resetDocument();
+}
+
+// Removes every shape as one undoable step; a lazily loaded document is decoded first
 void CanvasWidget::clearCanvas(){
+    materializeAll();
+    if(m_shapes.isEmpty())
+        return;
+    m_undoStack.push(new RemoveShapesCommand(this, m_shapes, "Clear"));
+}
+
+void CanvasWidget::resetDocument(){
+    m_animations.clear();
+    m_undoStack.clear();
     qDeleteAll(m_shapes);
+    qDeleteAll(m_pendingRects.keys());
     m_shapes.clear();
+    m_index.clear();
+    m_pendingRects.clear();
+    m_recordCache.clear();
+    m_lazyDocument.reset();
+    m_journal.discard();
+    m_journalIds.clear();
+    m_journalDirty.clear();
+    m_journalTimer.stop();
+    m_nextJournalId = 1;
+    for(PendingSave& save : m_pendingSaves)
+        save.current = false;
+    m_topZ = 0;
+    m_bottomZ = 0;
     m_currentShape = nullptr;
+    m_selectedShape = nullptr;
     m_isModified = false;
     emit fileModified(false);
-    update();
+    resetView();
 }
 
 void CanvasWidget::deleteSelectedShape(){
     if(!m_currentShape)
         return;
 
-    m_shapes.removeOne(m_currentShape);
+    if(m_index.contains(m_currentShape)){
+        m_undoStack.push(new RemoveShapesCommand(this, {m_currentShape}, "Delete " + m_currentShape->name()));
+        return;
+    }
+
+    // A shape still being drawn is not part of the document yet
+    untrackShape(m_currentShape);
     delete m_currentShape;
     m_currentShape = nullptr;
-    m_isModified = true;
-    emit fileModified(true);
-    update();
+    m_isDrawing = false;
 }
 
 
 void CanvasWidget::bringToFront()
 {
-    if (!m_currentShape) return;
-    
-    m_shapes.removeOne(m_currentShape);
-    m_shapes.append(m_currentShape);
-    m_isModified = true;
-    emit fileModified(true);
-    update();
+    if (!m_currentShape || !m_index.contains(m_currentShape)) return;
+
+    m_undoStack.push(new ZOrderCommand(this, m_currentShape, ++m_topZ, "Bring to front"));
 }
 
 void CanvasWidget::sendToBack()
 {
-    if (!m_currentShape) return;
-    
-    m_shapes.removeOne(m_currentShape);
-    m_shapes.prepend(m_currentShape);
-    m_isModified = true;
-    emit fileModified(true);
-    update();
+    if (!m_currentShape || !m_index.contains(m_currentShape)) return;
+
+    m_undoStack.push(new ZOrderCommand(this, m_currentShape, --m_bottomZ, "Send to back"));
+}
+
+QUndoStack* CanvasWidget::undoStack(){
+    return &m_undoStack;
+}
+
+AnimationManager* CanvasWidget::animations(){
+    return &m_animations;
+}
+
+void CanvasWidget::addShapes(const QVector<Shape*>& shapes, const QVector<qint64>& z){
+    QRect dirty;
+    const int existing = m_shapes.size();
+    for(int i = 0; i < shapes.size(); ++i){
+        Shape* shape = shapes[i];
+        connect(shape, &Shape::shapeChanged, this, &CanvasWidget::handleShapeChanged, Qt::UniqueConnection);
+        if(shapes.size() == 1){
+            insertShape(shape, z[i]);
+        }
+        else{
+            m_index.insert(shape, shape->repaintRect(), z[i]);
+            m_shapes.append(shape);
+        }
+        dirty |= m_index.rect(shape);
+        journalShape(shape);
+    }
+
+    // Bulk restores sort only the restored shapes and merge them into the
+    // already sorted list, instead of inserting shape by shape
+    if(shapes.size() > 1){
+        auto byZ = [this](Shape* a, Shape* b){
+            return m_index.z(a) < m_index.z(b);
+        };
+        std::sort(m_shapes.begin() + existing, m_shapes.end(), byZ);
+        std::inplace_merge(m_shapes.begin(), m_shapes.begin() + existing, m_shapes.end(), byZ);
+    }
+    invalidateStatic(dirty);
+}
+
+void CanvasWidget::removeShapes(const QVector<Shape*>& shapes){
+    QRect dirty;
+    for(Shape* shape : shapes){
+        if(shape == m_currentShape)
+            m_currentShape = nullptr;
+        if(shape == m_selectedShape){
+            shape->setSelected(false);
+            m_selectedShape = nullptr;
+        }
+        dirty |= m_index.rect(shape);
+    }
+
+    if(shapes.size() == 1){
+        m_shapes.erase(findShape(shapes.first()));
+    }
+    else{
+        QSet<Shape*> removed(shapes.begin(), shapes.end());
+        m_shapes.erase(std::remove_if(m_shapes.begin(), m_shapes.end(), [&removed](Shape* shape){
+            return removed.contains(shape);
+        }), m_shapes.end());
+    }
+
+    for(Shape* shape : shapes){
+        m_animations.forget(shape);
+        m_recordCache.remove(shape);
+        // A shape that comes back through undo is journaled again under a new id
+        m_journalDirty.remove(shape);
+        auto id = m_journalIds.find(shape);
+        if(id != m_journalIds.end()){
+            m_journal.remove(*id);
+            m_journalIds.erase(id);
+        }
+        disconnect(shape, &Shape::shapeChanged, this, &CanvasWidget::handleShapeChanged);
+        m_index.remove(shape);
+    }
+    invalidateStatic(dirty);
+}
+
+void CanvasWidget::setShapeZ(Shape* shape, qint64 z){
+    m_shapes.erase(findShape(shape));
+    m_index.setZ(shape, z);
+    insertSorted(shape, z);
+    m_topZ = qMax(m_topZ, z);
+    m_bottomZ = qMin(m_bottomZ, z);
+    m_journal.setZ(journalId(shape), z);
+    invalidateStatic(m_index.rect(shape));
+}
+
+qint64 CanvasWidget::shapeZ(Shape* shape) const{
+    return m_index.z(shape);
+}
+
+void CanvasWidget::keyPressEvent(QKeyEvent* event){
+    // Arrow keys nudge the selected shape, Shift for bigger steps
+    if(m_selectedShape && m_index.contains(m_selectedShape)){
+        int step = (event->modifiers() & Qt::ShiftModifier) ? 10 : 1;
+        QPoint offset;
+        switch(event->key()){
+            case Qt::Key_Left: offset = QPoint(-step, 0); break;
+            case Qt::Key_Right: offset = QPoint(step, 0); break;
+            case Qt::Key_Up: offset = QPoint(0, -step); break;
+            case Qt::Key_Down: offset = QPoint(0, step); break;
+            default: break;
+        }
+        if(!offset.isNull()){
+            m_undoStack.push(new MoveShapeCommand(this, m_selectedShape, offset));
+            return;
+        }
+    }
+
+    // Without a selection they scroll the view
+    switch(event->key()){
+        case Qt::Key_Left: panBy(QPoint(PanStep, 0)); return;
+        case Qt::Key_Right: panBy(QPoint(-PanStep, 0)); return;
+        case Qt::Key_Up: panBy(QPoint(0, PanStep)); return;
+        case Qt::Key_Down: panBy(QPoint(0, -PanStep)); return;
+        default: break;
+    }
+    QWidget::keyPressEvent(event);
 }
 
 void CanvasWidget::startAnimation(){
-    if(!m_currentShape)
+    if(!m_currentShape || m_animations.isAnimating(m_currentShape))
         return;
-    /*
-        Animation
-    */
-    QMessageBox::information(this, "Animation", "Animation for " + m_currentShape->name());
+    m_animations.animate(m_currentShape, AnimationManager::Property::Rotation, 360.0, 2000,
+                         AnimationManager::Loop::Repeat, QEasingCurve(QEasingCurve::Linear));
 }
 
 void CanvasWidget::stopAnimation(){
-    /*
-        Stop
-    */
+    if(m_currentShape)
+        m_animations.stop(m_currentShape);
 }
 
-void CanvasWidget::resizeEvent(QResizeEvent *event)
-{
-    if (event->oldSize().width() > 0 && event->oldSize().height() > 0) {
-        double xFactor = width() / double(event->oldSize().width());
-        double yFactor = height() / double(event->oldSize().height());
-        scaleShapes(qMin(xFactor, yFactor));
+qreal CanvasWidget::zoom() const{
+    return m_zoom;
+}
+
+void CanvasWidget::setZoom(qreal zoom, const QPointF& anchor){
+    zoom = qBound(MinZoom, zoom, MaxZoom);
+    if(qFuzzyCompare(zoom, m_zoom))
+        return;
+
+    QPointF document = (anchor - m_pan) / m_zoom;
+    m_zoom = zoom;
+    m_pan = anchor - document * m_zoom;
+    invalidateView();
+    emit zoomChanged(m_zoom);
+}
+
+void CanvasWidget::zoomIn(){
+    setZoom(m_zoom * ZoomStep, QRectF(rect()).center());
+}
+
+void CanvasWidget::zoomOut(){
+    setZoom(m_zoom / ZoomStep, QRectF(rect()).center());
+}
+
+void CanvasWidget::resetView(){
+    bool zoomed = !qFuzzyCompare(m_zoom, 1.0);
+    m_zoom = 1.0;
+    m_pan = QPointF();
+    invalidateView();
+    if(zoomed)
+        emit zoomChanged(m_zoom);
+}
+
+void CanvasWidget::panBy(const QPoint& delta){
+    if(delta.isNull())
+        return;
+    m_pan += delta;
+    scrollStaticLayer(delta);
+}
+
+QRect CanvasWidget::visibleDocumentRect() const{
+    return toDocument(rect());
+}
+
+void CanvasWidget::wheelEvent(QWheelEvent* event){
+    // Ctrl+wheel zooms around the cursor, the wheel alone pans
+    if(event->modifiers() & Qt::ControlModifier){
+        setZoom(m_zoom * qPow(ZoomStep, event->angleDelta().y() / 120.0), event->position());
+    }
+    else{
+        // Trackpads report pixels; a wheel notch is 120 eighths of a degree
+        QPoint delta = event->pixelDelta();
+        if(delta.isNull())
+            delta = event->angleDelta() * PanStep / 120;
+        if((event->modifiers() & Qt::ShiftModifier) && delta.x() == 0)
+            delta = QPoint(delta.y(), 0);
+        panBy(delta);
     }
-    QWidget::resizeEvent(event);
+    event->accept();
 }
 
-void CanvasWidget::scaleShapes(double factor)
-{
-    for (Shape *shape : m_shapes) {
-        shape->scale(factor);
+bool CanvasWidget::event(QEvent* event){
+    if(event->type() == QEvent::NativeGesture){
+        QNativeGestureEvent* gesture = static_cast<QNativeGestureEvent*>(event);
+        if(gesture->gestureType() == Qt::ZoomNativeGesture){
+            setZoom(m_zoom * (1.0 + gesture->value()), gesture->position());
+            return true;
+        }
+    }
+    else if(event->type() == QEvent::Gesture){
+        QGestureEvent* gestures = static_cast<QGestureEvent*>(event);
+        if(QPinchGesture* pinch = static_cast<QPinchGesture*>(gestures->gesture(Qt::PinchGesture))){
+            if(pinch->changeFlags() & QPinchGesture::ScaleFactorChanged)
+                setZoom(m_zoom * pinch->scaleFactor(), mapFromGlobal(pinch->centerPoint()));
+            gestures->accept(pinch);
+            return true;
+        }
+    }
+    return QWidget::event(event);
+}
+
+void CanvasWidget::commitShape(Shape* shape){
+    if(m_index.contains(shape))
+        return;
+
+    updateDocument(m_pendingRects.take(shape));
+    m_undoStack.push(new AddShapesCommand(this, {shape}, {++m_topZ}, "Draw " + shape->name()));
+}
+
+void CanvasWidget::insertShape(Shape* shape, qint64 z){
+    m_index.insert(shape, shape->repaintRect(), z);
+    insertSorted(shape, z);
+}
+
+QList<Shape*>::iterator CanvasWidget::findShape(Shape* shape){
+    // z values are unique, so the list position comes from a binary search
+    qint64 z = m_index.z(shape);
+    auto it = std::lower_bound(m_shapes.begin(), m_shapes.end(), z, [this](Shape* other, qint64 value){
+        return m_index.z(other) < value;
+    });
+    if(it != m_shapes.end() && *it == shape)
+        return it;
+    return std::find(m_shapes.begin(), m_shapes.end(), shape);
+}
+
+void CanvasWidget::insertSorted(Shape* shape, qint64 z){
+    auto position = std::upper_bound(m_shapes.begin(), m_shapes.end(), z, [this](qint64 value, Shape* other){
+        return value < m_index.z(other);
+    });
+    m_shapes.insert(position, shape);
+}
+
+void CanvasWidget::materialize(const QRect& rect){
+    if(m_lazyDocument)
+        adoptRecords(m_lazyDocument->take(rect));
+}
+
+void CanvasWidget::materializeAll(){
+    if(m_lazyDocument)
+        adoptRecords(m_lazyDocument->takeAll());
+}
+
+void CanvasWidget::adoptRecords(const QVector<int>& records){
+    // Callers are about to paint or hit-test this area, so decoded shapes
+    // go straight into the document without invalidating anything
+    for(int record : records){
+        Shape* shape = m_lazyDocument->decode(record);
+        if(shape){
+            connect(shape, &Shape::shapeChanged, this, &CanvasWidget::handleShapeChanged);
+            insertShape(shape, record + 1);
+            m_journalIds.insert(shape, quint64(record) + 1);
+        }
+    }
+
+    // Drop the mapping once everything is decoded
+    if(m_lazyDocument->pendingCount() == 0)
+        m_lazyDocument.reset();
+}
+
+void CanvasWidget::trackShape(Shape* shape){
+    connect(shape, &Shape::shapeChanged, this, &CanvasWidget::handleShapeChanged);
+    invalidateShape(shape);
+}
+
+void CanvasWidget::handleShapeChanged(){
+    invalidateShape(static_cast<Shape*>(sender()));
+}
+
+void CanvasWidget::untrackShape(Shape* shape){
+    m_animations.forget(shape);
+    m_recordCache.remove(shape);
+    disconnect(shape, &Shape::shapeChanged, this, &CanvasWidget::handleShapeChanged);
+    if(m_index.contains(shape)){
+        invalidateStatic(m_index.rect(shape));
+        m_index.remove(shape);
+    }
+    else{
+        updateDocument(m_pendingRects.take(shape));
+    }
+}
+
+quint64 CanvasWidget::journalId(Shape* shape){
+    auto it = m_journalIds.find(shape);
+    if(it == m_journalIds.end())
+        it = m_journalIds.insert(shape, m_nextJournalId++);
+    return *it;
+}
+
+void CanvasWidget::journalShape(Shape* shape){
+    m_journalDirty.insert(shape);
+    if(!m_journalTimer.isActive())
+        m_journalTimer.start();
+}
+
+// Writes the shapes changed since the last flush as whole records. Encoding
+// goes through the record cache, so the next save reuses it.
+void CanvasWidget::flushJournal(){
+    m_journalTimer.stop();
+    if(m_journal.document().isEmpty()){
+        m_journalDirty.clear();
+        return;
+    }
+
+    const QSet<Shape*> dirty = m_journalDirty;
+    m_journalDirty.clear();
+    for(Shape* shape : dirty)
+        m_journal.put(journalId(shape), m_index.z(shape), cachedRecord(shape));
+
+    // Drop superseded entries from a long journal; only saves write the
+    // document itself. Running saves hold journal positions, so wait for them.
+    if(m_pendingSaves.isEmpty() && m_journal.position() > qMax(qint64(JournalCompactBytes), 2 * m_journal.compactedSize()))
+        m_journal.compact();
+}
+
+void CanvasWidget::handleSaveFinished(const QString& fileName, bool ok){
+    PendingSave save = m_pendingSaves.takeFirst();
+    if(save.current){
+        if(ok){
+            // The file now holds everything up to the save's journal position
+            m_journal.rebase(fileName, save.slots, save.journalPosition);
+            for(PendingSave& later : m_pendingSaves)
+                later.journalPosition -= save.journalPosition;
+            // Edits made while the file was written keep the document modified
+            if(save.historyStep == m_historySteps)
+                m_undoStack.setClean();
+        }
+    }
+    emit saveFinished(fileName, ok);
+}
+
+void CanvasWidget::invalidateShape(Shape* shape){
+    QRect current = shape->repaintRect();
+    if(m_index.contains(shape)){
+        m_recordCache.remove(shape);
+        journalShape(shape);
+        QRect painted = m_index.rect(shape);
+        if(painted != current){
+            m_index.update(shape, current);
+            invalidateStatic(painted);
+        }
+        invalidateStatic(current);
     }
+    else{
+        // Shape being drawn lives outside the static layer until it is committed
+        QRect& painted = m_pendingRects[shape];
+        if(painted != current){
+            updateDocument(painted);
+            painted = current;
+        }
+        updateDocument(current);
+    }
+}
+
+QTransform CanvasWidget::viewTransform() const{
+    return QTransform(m_zoom, 0, 0, m_zoom, m_pan.x(), m_pan.y());
+}
+
+QPoint CanvasWidget::toDocument(const QPoint& pos) const{
+    return ((QPointF(pos) - m_pan) / m_zoom).toPoint();
+}
+
+QRect CanvasWidget::toDocument(const QRect& rect) const{
+    return viewTransform().inverted().mapRect(QRectF(rect)).toAlignedRect();
+}
+
+QRect CanvasWidget::toView(const QRect& rect) const{
+    return viewTransform().mapRect(QRectF(rect)).toAlignedRect();
+}
+
+void CanvasWidget::updateDocument(const QRect& rect){
+    update(toView(rect));
+}
+
+void CanvasWidget::invalidateStatic(const QRect& rect){
+    // Damage outside the view is dropped, that part is redrawn when it scrolls in
+    QRect view = toView(rect) & this->rect();
+    m_staticDirty += view;
+    update(view);
+}
+
+void CanvasWidget::invalidateStatic(const QRegion& region){
+    QRegion view;
+    for(const QRect& rect : region)
+        view += toView(rect) & this->rect();
+    m_staticDirty += view;
+    update(view);
+}
+
+void CanvasWidget::invalidateView(){
+    m_staticDirty = rect();
     update();
-}
\ No newline at end of file
+}
+
+// Pans move what is already rendered and only draw the strip that scrolls in
+void CanvasWidget::scrollStaticLayer(const QPoint& delta){
+    const QPointF shift = QPointF(delta) * m_staticLayer.devicePixelRatio();
+    if(m_staticLayer.isNull() || shift != QPointF(shift.toPoint())
+        || qAbs(delta.x()) >= width() || qAbs(delta.y()) >= height()){
+        invalidateView();
+        return;
+    }
+
+    QImage scrolled(m_staticLayer.size(), m_staticLayer.format());
+    scrolled.setDevicePixelRatio(m_staticLayer.devicePixelRatio());
+    {
+        QPainter painter(&scrolled);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.drawImage(delta, m_staticLayer);
+    }
+    m_staticLayer = scrolled;
+
+    m_staticDirty.translate(delta);
+    m_staticDirty += QRegion(rect()) - QRegion(rect().translated(delta));
+    m_staticDirty &= rect();
+    update();
+}
+
+void CanvasWidget::handleAnimationFrame(const QVector<Shape*>& shapes){
+    // Animated shapes change with their signals blocked; the whole tick
+    // becomes one index pass and one repaint of the union of their rects.
+    // Frames are not journaled, handleAnimationFinished() journals the end state.
+    QRegion dirty;
+    for(Shape* shape : shapes){
+        if(!m_index.contains(shape))
+            continue;
+        m_recordCache.remove(shape);
+        QRect painted = m_index.rect(shape);
+        QRect current = shape->repaintRect();
+        dirty += painted;
+        if(current != painted){
+            m_index.update(shape, current);
+            dirty += current;
+        }
+    }
+    invalidateStatic(dirty);
+}
+
+void CanvasWidget::handleAnimationFinished(Shape* shape){
+    if(m_index.contains(shape))
+        journalShape(shape);
+}
+
+void CanvasWidget::updateStaticLayer(){
+    const qreal dpr = devicePixelRatioF();
+    const QSize pixelSize = size() * dpr;
+    if(m_staticLayer.size() != pixelSize || m_staticLayer.devicePixelRatio() != dpr){
+        m_staticLayer = QImage(pixelSize, QImage::Format_ARGB32_Premultiplied);
+        m_staticLayer.setDevicePixelRatio(dpr);
+        m_staticDirty = rect();
+    }
+
+    if(m_staticDirty.isEmpty())
+        return;
+
+    // The dirty region never leaves the widget, so shapes outside the
+    // visible part of the document are not even visited
+    const QRect dirtyBounds = m_staticDirty.boundingRect();
+    const QRect area = toDocument(dirtyBounds);
+    materialize(area);
+    const QVector<Shape*> candidates = m_index.query(area);
+    PAINT_STATS(m_stats.addVisited(candidates.size()));
+
+    // Big repaints (a resize, a zoom, a new document) are split into tiles
+    // drawn on all cores; the whole bounding rect is redrawn then, not just the region
+    const QRect pixels = QRectF(QPointF(dirtyBounds.topLeft()) * dpr, QSizeF(dirtyBounds.size()) * dpr).toAlignedRect();
+    if(qint64(pixels.width()) * pixels.height() >= TiledRepaintPixels){
+        DocumentRenderer::renderTiled(candidates, viewTransform(), m_staticLayer, pixels);
+        PAINT_STATS(m_stats.addDrawn(candidates.size()));
+        m_staticDirty = QRegion();
+        return;
+    }
+
+    QPainter painter(&m_staticLayer);
+    painter.setClipRegion(m_staticDirty);
+    for(const QRect& r : m_staticDirty){
+        painter.fillRect(r, Qt::white);
+    }
+
+    QVector<Shape*> visible;
+    visible.reserve(candidates.size());
+    for(Shape* shape : candidates){
+        if(m_staticDirty.intersects(toView(m_index.rect(shape))))
+            visible.append(shape);
+    }
+    PAINT_STATS(m_stats.addDrawn(visible.size()));
+    painter.setTransform(viewTransform());
+    DocumentRenderer::drawShapes(&painter, visible);
+
+    m_staticDirty = QRegion();
+}
+
+#ifdef PAINT_INSTRUMENTATION
+bool CanvasWidget::isStatsHudVisible() const{
+    return m_stats.isHudVisible();
+}
+
+void CanvasWidget::setStatsHudVisible(bool visible){
+    m_stats.setHudVisible(visible);
+    if(visible)
+        m_hudTimer.start();
+    else
+        m_hudTimer.stop();
+    update(m_stats.hudRect());
+}
+
+bool CanvasWidget::dumpFrameStats(const QString& fileName) const{
+    return m_stats.dump(fileName);
+}
+#endif
@@ -0,0 +1,321 @@
+#include "../include/DocumentIO.h"
+#include "../include/BinaryStream.h"
+#include "../include/shapes/LineShape.h"
+#include "../include/shapes/FreehandShape.h"
+#include "../include/shapes/RectangleShape.h"
+#include "../include/shapes/EllipseShape.h"
+#include "../include/shapes/PolygonShape.h"
+#include "../include/shapes/RegularPolygonShape.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <cstring>
+
+static const char BinaryMagic[4] = {'P', 'N', 'T', 'B'};
+
+// Collects records into a bounded chunk buffer that is flushed to the device
+// as it fills, so memory use does not grow with the document
+class ChunkWriter{
+
+    public:
+        ChunkWriter(QIODevice* device, int maxShapes, int maxBytes)
+            : m_device(device), m_maxShapes(maxShapes), m_maxBytes(maxBytes), m_out(&m_chunk){}
+
+        bool writeHeader(quint16 version){
+            QByteArray header;
+            BinaryWriter out(&header);
+            header.append(BinaryMagic, sizeof(BinaryMagic));
+            out.writeUInt16(version);
+            out.writeUInt16(0);
+            return m_device->write(header) == header.size();
+        }
+
+        bool append(Shape::Type type, const QRect& bounds, const QByteArray& payload){
+            m_out.writeByte(quint8(type));
+            m_out.writeRect(bounds);
+            m_out.writeVarint(quint64(payload.size()));
+            m_out.writeBytes(payload);
+            if(++m_count >= quint32(m_maxShapes) || m_chunk.size() >= m_maxBytes)
+                return flush();
+            return true;
+        }
+
+        // Flushes the last chunk and writes the end marker
+        bool finish(){
+            if(m_count > 0 && !flush())
+                return false;
+            return flush();
+        }
+
+    private:
+        bool flush(){
+            QByteArray chunkHeader;
+            BinaryWriter out(&chunkHeader);
+            out.writeUInt32(quint32(m_chunk.size()));
+            out.writeUInt32(m_count);
+            bool ok = m_device->write(chunkHeader) == chunkHeader.size()
+                   && m_device->write(m_chunk) == m_chunk.size();
+            m_chunk.resize(0);
+            m_count = 0;
+            return ok;
+        }
+
+        QIODevice* m_device;
+        int m_maxShapes;
+        int m_maxBytes;
+        QByteArray m_chunk;
+        BinaryWriter m_out;
+        quint32 m_count = 0;
+};
+
+const char* DocumentIO::BinarySuffix = "paintb";
+
+DocumentIO::Format DocumentIO::formatForFile(const QString& fileName){
+    if(QFileInfo(fileName).suffix().compare(BinarySuffix, Qt::CaseInsensitive) == 0)
+        return Format::Binary;
+    return Format::Json;
+}
+
+bool DocumentIO::save(const QList<Shape*>& shapes, const QString& fileName){
+    QSaveFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly)){
+        return false;
+    }
+
+    bool ok = formatForFile(fileName) == Format::Binary ? writeBinary(shapes, &file)
+                                                        : writeJson(shapes, &file);
+    if(!ok){
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool DocumentIO::save(const QVector<Record>& records, const QString& fileName){
+    if(formatForFile(fileName) != Format::Binary){
+        return false;
+    }
+
+    QSaveFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly)){
+        return false;
+    }
+
+    if(!writeBinary(records, &file)){
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool DocumentIO::load(const QString& fileName, QList<Shape*>& shapes){
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly)){
+        return false;
+    }
+
+    QByteArray data = file.readAll();
+    if(formatForFile(fileName) == Format::Binary)
+        return readBinary(data.constData(), data.size(), shapes);
+    return readJson(data, shapes);
+}
+
+bool DocumentIO::writeJson(const QList<Shape*>& shapes, QIODevice* device){
+    QJsonArray shapesArray;
+    for(Shape* shape : shapes){
+        shapesArray.append(shape->toJson());
+    }
+
+    const QByteArray bytes = QJsonDocument(shapesArray).toJson();
+    return device->write(bytes) == bytes.size();
+}
+
+bool DocumentIO::readJson(const QByteArray& data, QList<Shape*>& shapes){
+    QJsonDocument doc = QJsonDocument::fromJson(data);
+    if(!doc.isArray()){
+        return false;
+    }
+
+    QJsonArray shapesArray = doc.array();
+    for(const QJsonValue& value : shapesArray){
+        QJsonObject shapeObject = value.toObject();
+        if(shapeObject.contains("type")){
+            Shape* shape = createShape(shapeObject["type"].toString());
+            if(shape){
+                shape->fromJson(shapeObject);
+                shapes.append(shape);
+            }
+        }
+    }
+    return true;
+}
+
+bool DocumentIO::writeBinary(const QList<Shape*>& shapes, QIODevice* device){
+    ChunkWriter writer(device, ChunkShapes, ChunkBytes);
+    if(!writer.writeHeader(BinaryVersion))
+        return false;
+
+    QByteArray payload;
+    BinaryWriter payloadOut(&payload);
+    for(Shape* shape : shapes){
+        payload.resize(0);
+        shape->writeBinary(payloadOut);
+
+        // Bounds cover the stroke too, so readers can cull records before decoding them
+        int margin = shape->penWidth();
+        if(!writer.append(shape->type(), shape->boundingRect().adjusted(-margin, -margin, margin, margin), payload))
+            return false;
+    }
+    return writer.finish();
+}
+
+bool DocumentIO::writeBinary(const QVector<Record>& records, QIODevice* device){
+    ChunkWriter writer(device, ChunkShapes, ChunkBytes);
+    if(!writer.writeHeader(BinaryVersion))
+        return false;
+
+    for(const Record& record : records){
+        if(!writer.append(record.type, record.bounds, record.payload))
+            return false;
+    }
+    return writer.finish();
+}
+
+DocumentIO::Record DocumentIO::encodeRecord(const Shape* shape){
+    Record record;
+    record.type = shape->type();
+    int margin = shape->penWidth();
+    record.bounds = shape->boundingRect().adjusted(-margin, -margin, margin, margin);
+    BinaryWriter out(&record.payload);
+    shape->writeBinary(out);
+    return record;
+}
+
+Shape* DocumentIO::decodeRecord(const Record& record){
+    BinaryRecord location{record.type, record.bounds, 0, record.payload.size()};
+    return decodeRecord(record.payload.constData(), location);
+}
+
+bool DocumentIO::readBinary(const char* data, qint64 size, QList<Shape*>& shapes){
+    QVector<BinaryRecord> records;
+    if(!scanBinary(data, size, records))
+        return false;
+
+    QList<Shape*> loaded;
+    loaded.reserve(records.size());
+    for(const BinaryRecord& record : records){
+        // Unknown record types from newer writers are skipped
+        if(!isKnownType(record.type))
+            continue;
+
+        Shape* shape = decodeRecord(data, record);
+        if(!shape){
+            qDeleteAll(loaded);
+            return false;
+        }
+        loaded.append(shape);
+    }
+
+    shapes.append(loaded);
+    return true;
+}
+
+bool DocumentIO::scanBinary(const char* data, qint64 size, QVector<BinaryRecord>& records){
+    BinaryReader in(data, size);
+    if(size < qint64(sizeof(BinaryMagic)) || std::memcmp(data, BinaryMagic, sizeof(BinaryMagic)) != 0)
+        return false;
+    in.skip(sizeof(BinaryMagic));
+    quint16 version = in.readUInt16();
+    in.readUInt16();
+    if(in.hasError() || version > BinaryVersion)
+        return false;
+
+    // Only record headers are read here, payloads are skipped over
+    while(true){
+        quint32 chunkSize = in.readUInt32();
+        quint32 chunkCount = in.readUInt32();
+        if(in.hasError())
+            return false;
+        if(chunkSize == 0 && chunkCount == 0)
+            return true;
+
+        qint64 chunkOffset = in.position();
+        BinaryReader chunk = in.subReader(chunkSize);
+        for(quint32 i = 0; i < chunkCount; ++i){
+            BinaryRecord record;
+            record.type = static_cast<Shape::Type>(chunk.readByte());
+            record.bounds = chunk.readRect();
+            record.length = qint64(chunk.readVarint());
+            record.offset = chunkOffset + chunk.position();
+            chunk.skip(record.length);
+            if(chunk.hasError())
+                return false;
+            records.append(record);
+        }
+        if(in.hasError())
+            return false;
+    }
+}
+
+Shape* DocumentIO::decodeRecord(const char* data, const BinaryRecord& record){
+    Shape* shape = createShape(record.type);
+    if(!shape)
+        return nullptr;
+
+    BinaryReader in(data + record.offset, record.length);
+    shape->readBinary(in);
+    if(in.hasError()){
+        delete shape;
+        return nullptr;
+    }
+    return shape;
+}
+
+bool DocumentIO::isKnownType(Shape::Type type){
+    switch(type){
+        case Shape::Type::Line:
+        case Shape::Type::Freehand:
+        case Shape::Type::Rectangle:
+        case Shape::Type::Ellipse:
+        case Shape::Type::Polygon:
+        case Shape::Type::RegularPolygon:
+            return true;
+    }
+    return false;
+}
+
+Shape* DocumentIO::createShape(Shape::Type type){
+    switch(type){
+        case Shape::Type::Line:
+            return new LineShape();
+        case Shape::Type::Freehand:
+            return new FreehandShape();
+        case Shape::Type::Rectangle:
+            return new RectangleShape();
+        case Shape::Type::Ellipse:
+            return new EllipseShape();
+        case Shape::Type::Polygon:
+            return new PolygonShape();
+        case Shape::Type::RegularPolygon:
+            return new RegularPolygonShape();
+    }
+    return nullptr;
+}
+
+Shape* DocumentIO::createShape(const QString& jsonType){
+    if(jsonType == "line")
+        return createShape(Shape::Type::Line);
+    if(jsonType == "freehand")
+        return createShape(Shape::Type::Freehand);
+    if(jsonType == "rectangle")
+        return createShape(Shape::Type::Rectangle);
+    if(jsonType == "ellipse")
+        return createShape(Shape::Type::Ellipse);
+    if(jsonType == "polygon")
+        return createShape(Shape::Type::Polygon);
+    if(jsonType == "regular_polygon")
+        return createShape(Shape::Type::RegularPolygon);
+    return nullptr;
+}
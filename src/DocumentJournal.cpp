@@ -0,0 +1,436 @@
+#include "../include/DocumentJournal.h"
+#include "../include/BinaryStream.h"
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QHash>
+#include <algorithm>
+#include <cstring>
+
+static const char JournalMagic[4] = {'P', 'N', 'T', 'J'};
+
+DocumentJournal::~DocumentJournal(){
+    m_file.close();
+}
+
+QString DocumentJournal::fileName(const QString& documentFile){
+    return documentFile + ".journal";
+}
+
+bool DocumentJournal::canRecover(const QString& documentFile){
+    QFile file(fileName(documentFile));
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    Extent extent;
+    bool edited = false;
+    walk(file.readAll(), documentFile, extent, [&edited](Op op, BinaryReader&){
+        edited = op != Op::Base;
+        return !edited;
+    });
+    return edited;
+}
+
+bool DocumentJournal::replay(const QString& documentFile, QVector<Entry>& entries){
+    QFile journal(fileName(documentFile));
+    QFile document(documentFile);
+    if(!journal.open(QIODevice::ReadOnly) || !document.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray journalData = journal.readAll();
+    QByteArray documentData = document.readAll();
+
+    // Records of the saved document in file order
+    QVector<DocumentIO::Record> base;
+    if(DocumentIO::formatForFile(documentFile) == DocumentIO::Format::Binary){
+        QVector<DocumentIO::BinaryRecord> records;
+        if(!DocumentIO::scanBinary(documentData.constData(), documentData.size(), records))
+            return false;
+        base.reserve(records.size());
+        for(const DocumentIO::BinaryRecord& record : records)
+            base.append({record.type, record.bounds, documentData.mid(record.offset, record.length)});
+    }
+    else{
+        QList<Shape*> shapes;
+        if(!DocumentIO::readJson(documentData, shapes))
+            return false;
+        base.reserve(shapes.size());
+        for(Shape* shape : shapes)
+            base.append(DocumentIO::encodeRecord(shape));
+        qDeleteAll(shapes);
+    }
+
+    QHash<quint64, Entry> shapes;
+    shapes.reserve(base.size());
+    for(int i = 0; i < base.size(); ++i)
+        shapes.insert(quint64(i) + 1, {quint64(i) + 1, qint64(i) + 1, base[i]});
+
+    Extent extent;
+    bool ok = walk(journalData, documentFile, extent, [&](Op op, BinaryReader& in){
+        switch(op){
+            case Op::Base:{
+                if(in.readVarint() != quint64(base.size()))
+                    return false;
+                shapes.clear();
+                for(const DocumentIO::Record& record : base){
+                    quint64 id = in.readVarint();
+                    qint64 z = in.readSVarint();
+                    shapes.insert(id, {id, z, record});
+                }
+                break;
+            }
+            case Op::Put:{
+                Entry entry;
+                entry.id = in.readVarint();
+                entry.z = in.readSVarint();
+                entry.record.type = Shape::Type(in.readByte());
+                entry.record.bounds = in.readRect();
+                entry.record.payload = QByteArray(in.current(), int(in.remaining()));
+                in.skip(in.remaining());
+                shapes.insert(entry.id, entry);
+                break;
+            }
+            case Op::Remove:
+                shapes.remove(in.readVarint());
+                break;
+            case Op::SetZ:{
+                quint64 id = in.readVarint();
+                qint64 z = in.readSVarint();
+                auto it = shapes.find(id);
+                if(it != shapes.end())
+                    it->z = z;
+                break;
+            }
+        }
+        return !in.hasError();
+    });
+    if(!ok)
+        return false;
+
+    entries.clear();
+    entries.reserve(shapes.size());
+    for(const Entry& entry : shapes){
+        if(DocumentIO::isKnownType(entry.record.type))
+            entries.append(entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b){
+        return a.z < b.z;
+    });
+    return true;
+}
+
+void DocumentJournal::setDocument(const QString& documentFile){
+    discard();
+    m_document = documentFile;
+    QFile::remove(fileName(documentFile));
+}
+
+bool DocumentJournal::resume(const QString& documentFile){
+    discard();
+
+    m_file.setFileName(fileName(documentFile));
+    if(!m_file.open(QIODevice::ReadWrite))
+        return false;
+
+    Extent extent;
+    if(!walk(m_file.readAll(), documentFile, extent, [](Op, BinaryReader&){ return true; })){
+        m_file.close();
+        return false;
+    }
+
+    // Drop whatever a crash left after the last intact entry
+    if(!m_file.resize(extent.end) || !m_file.seek(extent.end)){
+        m_file.close();
+        return false;
+    }
+    m_document = documentFile;
+    m_editsStart = extent.edits;
+    m_position = extent.end - extent.edits;
+    return true;
+}
+
+void DocumentJournal::discard(){
+    if(m_file.isOpen()){
+        m_file.close();
+        m_file.remove();
+    }
+    m_document.clear();
+    m_base.clear();
+    m_editsStart = 0;
+    m_position = 0;
+    m_compactedSize = 0;
+}
+
+QString DocumentJournal::document() const{
+    return m_document;
+}
+
+qint64 DocumentJournal::position() const{
+    return m_position;
+}
+
+qint64 DocumentJournal::compactedSize() const{
+    return m_compactedSize;
+}
+
+bool DocumentJournal::put(quint64 id, qint64 z, const DocumentIO::Record& record){
+    return append(Op::Put, putPayload(id, z, record));
+}
+
+bool DocumentJournal::remove(quint64 id){
+    QByteArray payload;
+    BinaryWriter out(&payload);
+    out.writeVarint(id);
+    return append(Op::Remove, payload);
+}
+
+bool DocumentJournal::setZ(quint64 id, qint64 z){
+    QByteArray payload;
+    BinaryWriter out(&payload);
+    out.writeVarint(id);
+    out.writeSVarint(z);
+    return append(Op::SetZ, payload);
+}
+
+bool DocumentJournal::rebase(const QString& documentFile, const QVector<Slot>& slots, qint64 from){
+    // Edits made while the save was running are not in the new file yet
+    QByteArray tail;
+    if(m_file.isOpen() && m_file.flush() && m_file.seek(m_editsStart + from)){
+        tail = m_file.read(m_position - from);
+        m_file.seek(m_file.size());
+    }
+
+    QByteArray base;
+    BinaryWriter out(&base);
+    out.writeVarint(quint64(slots.size()));
+    for(const Slot& slot : slots){
+        out.writeVarint(slot.id);
+        out.writeSVarint(slot.z);
+    }
+
+    // Without carried over edits the journal is only written once there is a new one
+    QString previous = m_file.isOpen() ? m_file.fileName() : QString();
+    m_file.close();
+    m_document = documentFile;
+    m_base = base;
+    m_editsStart = 0;
+    m_position = 0;
+    m_compactedSize = 0;
+    if(tail.isEmpty()){
+        if(!previous.isEmpty())
+            QFile::remove(previous);
+        return true;
+    }
+
+    QSaveFile file(fileName(documentFile));
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    QByteArray head = header(documentFile) + entry(Op::Base, m_base);
+    file.write(head);
+    file.write(tail);
+    if(!file.commit())
+        return false;
+    if(!previous.isEmpty() && previous != file.fileName())
+        QFile::remove(previous);
+
+    m_base.clear();
+    m_file.setFileName(fileName(documentFile));
+    if(!m_file.open(QIODevice::ReadWrite) || !m_file.seek(m_file.size()))
+        return false;
+    m_editsStart = head.size();
+    m_position = tail.size();
+    return true;
+}
+
+bool DocumentJournal::compact(){
+    if(!m_file.isOpen() || !m_file.flush() || !m_file.seek(0))
+        return false;
+    QByteArray data = m_file.read(m_editsStart + m_position);
+    m_file.seek(m_file.size());
+
+    // Net change per shape, in the order the shapes were first touched
+    struct Change{
+        Op op;
+        qint64 z;
+        DocumentIO::Record record;
+    };
+    QHash<quint64, Change> changes;
+    QVector<quint64> order;
+    Extent extent;
+    bool ok = walk(data, m_document, extent, [&](Op op, BinaryReader& in){
+        if(op == Op::Base)
+            return true;
+        quint64 id = in.readVarint();
+        auto it = changes.find(id);
+        if(it == changes.end()){
+            it = changes.insert(id, Change{op, 0, DocumentIO::Record()});
+            order.append(id);
+        }
+        switch(op){
+            case Op::Put:
+                it->op = Op::Put;
+                it->z = in.readSVarint();
+                it->record.type = Shape::Type(in.readByte());
+                it->record.bounds = in.readRect();
+                it->record.payload = QByteArray(in.current(), int(in.remaining()));
+                in.skip(in.remaining());
+                break;
+            case Op::Remove:
+                it->op = Op::Remove;
+                break;
+            case Op::SetZ:
+                // Replay ignores a new z for a removed shape
+                if(it->op != Op::Remove)
+                    it->z = in.readSVarint();
+                else
+                    in.skip(in.remaining());
+                break;
+            case Op::Base:
+                break;
+        }
+        return !in.hasError();
+    });
+    if(!ok || extent.end != data.size())
+        return false;
+
+    QByteArray edits;
+    for(quint64 id : order){
+        const Change& change = changes[id];
+        QByteArray payload;
+        if(change.op == Op::Put){
+            payload = putPayload(id, change.z, change.record);
+        }
+        else{
+            BinaryWriter out(&payload);
+            out.writeVarint(id);
+            if(change.op == Op::SetZ)
+                out.writeSVarint(change.z);
+        }
+        edits += entry(change.op, payload);
+    }
+
+    // Same header and Base entry, so the journal still belongs to the saved file
+    QSaveFile file(m_file.fileName());
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    file.write(data.constData(), extent.edits);
+    file.write(edits);
+    // Closed first, an open file cannot be replaced everywhere
+    m_file.close();
+    bool committed = file.commit();
+    if(!m_file.open(QIODevice::ReadWrite) || !m_file.seek(m_file.size()))
+        return false;
+    if(!committed)
+        return false;
+    m_editsStart = extent.edits;
+    m_position = edits.size();
+    m_compactedSize = m_position;
+    return true;
+}
+
+bool DocumentJournal::append(Op op, const QByteArray& payload){
+    if(!ensureOpen())
+        return false;
+
+    // Flushed right away so the entry survives the application crashing
+    QByteArray bytes = entry(op, payload);
+    if(m_file.write(bytes) != bytes.size() || !m_file.flush())
+        return false;
+    m_position += bytes.size();
+    return true;
+}
+
+bool DocumentJournal::ensureOpen(){
+    if(m_file.isOpen())
+        return true;
+    if(m_document.isEmpty())
+        return false;
+
+    m_file.setFileName(fileName(m_document));
+    if(!m_file.open(QIODevice::ReadWrite | QIODevice::Truncate))
+        return false;
+
+    QByteArray head = header(m_document);
+    if(!m_base.isEmpty())
+        head += entry(Op::Base, m_base);
+    if(m_file.write(head) != head.size()){
+        m_file.close();
+        return false;
+    }
+    m_base.clear();
+    m_editsStart = head.size();
+    m_position = 0;
+    return true;
+}
+
+// The document's size and modification time tie the journal to the saved
+// contents it was written against
+QByteArray DocumentJournal::header(const QString& documentFile){
+    QFileInfo info(documentFile);
+    QByteArray bytes(JournalMagic, sizeof(JournalMagic));
+    BinaryWriter out(&bytes);
+    out.writeUInt16(Version);
+    out.writeVarint(quint64(info.size()));
+    out.writeSVarint(info.lastModified().toMSecsSinceEpoch());
+    return bytes;
+}
+
+QByteArray DocumentJournal::putPayload(quint64 id, qint64 z, const DocumentIO::Record& record){
+    QByteArray payload;
+    BinaryWriter out(&payload);
+    out.writeVarint(id);
+    out.writeSVarint(z);
+    out.writeByte(quint8(record.type));
+    out.writeRect(record.bounds);
+    out.writeBytes(record.payload);
+    return payload;
+}
+
+QByteArray DocumentJournal::entry(Op op, const QByteArray& payload){
+    QByteArray bytes;
+    bytes.reserve(payload.size() + 16);
+    BinaryWriter out(&bytes);
+    out.writeByte(quint8(op));
+    out.writeVarint(quint64(payload.size()));
+    out.writeUInt16(qChecksum(payload));
+    out.writeBytes(payload);
+    return bytes;
+}
+
+bool DocumentJournal::walk(const QByteArray& data, const QString& documentFile, Extent& extent,
+                           const std::function<bool(Op, BinaryReader&)>& visit){
+    if(data.size() < qsizetype(sizeof(JournalMagic))
+        || std::memcmp(data.constData(), JournalMagic, sizeof(JournalMagic)) != 0)
+        return false;
+
+    QFileInfo info(documentFile);
+    BinaryReader in(data.constData(), data.size());
+    in.skip(sizeof(JournalMagic));
+    quint16 version = in.readUInt16();
+    quint64 size = in.readVarint();
+    qint64 modified = in.readSVarint();
+    if(in.hasError() || version > Version || !info.exists()
+        || size != quint64(info.size()) || modified != info.lastModified().toMSecsSinceEpoch())
+        return false;
+
+    extent.base = in.position();
+    extent.edits = extent.base;
+    extent.end = extent.base;
+    while(!in.atEnd()){
+        quint8 op = in.readByte();
+        quint64 length = in.readVarint();
+        quint16 checksum = in.readUInt16();
+        if(in.hasError() || length > quint64(in.remaining()) || op < quint8(Op::Base) || op > quint8(Op::SetZ))
+            break;
+        if(qChecksum(QByteArrayView(in.current(), qsizetype(length))) != checksum)
+            break;
+
+        BinaryReader payload = in.subReader(qint64(length));
+        bool first = extent.end == extent.base;
+        if(!visit(Op(op), payload))
+            break;
+        extent.end = in.position();
+        if(first && Op(op) == Op::Base)
+            extent.edits = extent.end;
+    }
+    return true;
+}
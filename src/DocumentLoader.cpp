@@ -0,0 +1,169 @@
+#include "../include/DocumentLoader.h"
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+
+DocumentLoader::DocumentLoader(QObject* parent) : QObject(parent){
+    m_pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+DocumentLoader::~DocumentLoader(){
+    cancel();
+    m_pool.waitForDone();
+    for(const QList<Shape*>& shapes : m_chunks)
+        qDeleteAll(shapes);
+}
+
+void DocumentLoader::start(const QString& fileName){
+    Q_ASSERT(!m_running);
+    m_running = true;
+    m_target = QThread::currentThread();
+    m_cancelled.storeRelaxed(0);
+    m_chunks.clear();
+    m_records.clear();
+    m_total = 0;
+    m_done = 0;
+    m_pendingChunks = 0;
+    m_ok = true;
+
+    m_pool.start([this, fileName](){ prepare(fileName); });
+}
+
+void DocumentLoader::cancel(){
+    m_cancelled.storeRelaxed(1);
+}
+
+bool DocumentLoader::isRunning() const{
+    return m_running;
+}
+
+QList<Shape*> DocumentLoader::takeShapes(){
+    QList<Shape*> shapes;
+    for(const QList<Shape*>& chunk : m_chunks)
+        shapes.append(chunk);
+    m_chunks.clear();
+    return shapes;
+}
+
+void DocumentLoader::prepare(const QString& fileName){
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly)){
+        fail();
+        return;
+    }
+    m_data = file.readAll();
+    file.close();
+
+    QJsonArray array;
+    bool binary = DocumentIO::formatForFile(fileName) == DocumentIO::Format::Binary;
+    if(binary){
+        if(!DocumentIO::scanBinary(m_data.constData(), m_data.size(), m_records)){
+            fail();
+            return;
+        }
+        m_total = m_records.size();
+    }
+    else{
+        QJsonDocument doc = QJsonDocument::fromJson(m_data);
+        m_data.clear();
+        if(!doc.isArray()){
+            fail();
+            return;
+        }
+        array = doc.array();
+        m_total = array.size();
+    }
+
+    int chunkCount = (m_total + ChunkShapes - 1) / ChunkShapes;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_chunks.resize(chunkCount);
+        m_pendingChunks = chunkCount;
+    }
+    emit progress(0, m_total);
+    if(chunkCount == 0){
+        finishChunk(-1, QList<Shape*>(), true);
+        return;
+    }
+
+    for(int chunk = 0; chunk < chunkCount; ++chunk){
+        int begin = chunk * ChunkShapes;
+        int end = qMin(begin + ChunkShapes, m_total);
+        // Every task gets its own handle on the shared array
+        if(binary)
+            m_pool.start([this, chunk, begin, end](){ decodeBinary(chunk, begin, end); });
+        else
+            m_pool.start([this, chunk, array, begin, end](){ decodeJson(chunk, array, begin, end); });
+    }
+}
+
+void DocumentLoader::decodeJson(int chunk, const QJsonArray& array, int begin, int end){
+    QList<Shape*> shapes;
+    for(int i = begin; i < end && !m_cancelled.loadRelaxed(); ++i){
+        QJsonObject object = array.at(i).toObject();
+        if(!object.contains("type"))
+            continue;
+
+        Shape* shape = DocumentIO::createShape(object.value("type").toString());
+        if(shape){
+            shape->fromJson(object);
+            shape->moveToThread(m_target);
+            shapes.append(shape);
+        }
+    }
+    finishChunk(chunk, shapes, true);
+}
+
+void DocumentLoader::decodeBinary(int chunk, int begin, int end){
+    QList<Shape*> shapes;
+    bool ok = true;
+    for(int i = begin; i < end && ok && !m_cancelled.loadRelaxed(); ++i){
+        // Unknown record types from newer writers are skipped
+        const DocumentIO::BinaryRecord& record = m_records[i];
+        if(!DocumentIO::isKnownType(record.type))
+            continue;
+
+        Shape* shape = DocumentIO::decodeRecord(m_data.constData(), record);
+        if(shape){
+            shape->moveToThread(m_target);
+            shapes.append(shape);
+        }
+        else{
+            ok = false;
+        }
+    }
+    finishChunk(chunk, shapes, ok);
+}
+
+void DocumentLoader::finishChunk(int chunk, const QList<Shape*>& shapes, bool ok){
+    QMutexLocker locker(&m_mutex);
+    if(chunk >= 0){
+        m_chunks[chunk] = shapes;
+        m_done += qMin(int(ChunkShapes), m_total - chunk * ChunkShapes);
+        --m_pendingChunks;
+    }
+    m_ok = m_ok && ok;
+    int done = m_done;
+    bool last = m_pendingChunks == 0;
+    bool result = m_ok && !m_cancelled.loadRelaxed();
+    locker.unlock();
+
+    emit progress(done, m_total);
+    if(!last)
+        return;
+
+    // Results are handed over on the loader's own thread, in document order
+    QMetaObject::invokeMethod(this, [this, result](){
+        m_data.clear();
+        m_records.clear();
+        if(!result)
+            qDeleteAll(takeShapes());
+        m_running = false;
+        emit finished(result);
+    }, Qt::QueuedConnection);
+}
+
+void DocumentLoader::fail(){
+    finishChunk(-1, QList<Shape*>(), false);
+}
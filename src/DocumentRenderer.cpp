@@ -0,0 +1,212 @@
+#include "../include/DocumentRenderer.h"
+#include "../include/shapes/LineShape.h"
+#include "../include/shapes/RectangleShape.h"
+#include <QAtomicInt>
+#include <QPainter>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+
+static QRect paintedRect(const Shape* shape){
+    int margin = shape->penWidth();
+    return shape->boundingRect().adjusted(-margin, -margin, margin, margin);
+}
+
+QRect DocumentRenderer::documentBounds(const QList<Shape*>& shapes){
+    QRect bounds;
+    for(const Shape* shape : shapes)
+        bounds |= paintedRect(shape);
+    return bounds;
+}
+
+// Lines, and unrotated rectangles without a visible fill, stroked with an
+// opaque solid pen come out the same in any order, so a run of them can be
+// handed to the painter as one array
+static bool isBatchable(const Shape* shape){
+    if(shape->isSelected() || shape->penStyle() != Qt::SolidLine || shape->penColor().alpha() != 255)
+        return false;
+    switch(shape->type()){
+        case Shape::Type::Line:
+            return true;
+        case Shape::Type::Rectangle:
+            return shape->fillColor().alpha() == 0 && qFuzzyIsNull(shape->rotationAngle());
+        default:
+            return false;
+    }
+}
+
+void DocumentRenderer::drawShapes(QPainter* painter, const QList<Shape*>& shapes){
+    painter->save();
+    const Shape* styled = nullptr;  // the painter holds this shape's pen and brush
+
+    // Collected from the shapes on every pass, so there is no copy of their
+    // geometry to go stale. Only one of the two holds anything at a time:
+    // the batch is flushed whenever the primitive kind changes, which keeps
+    // a mixed run of lines and rectangles in paint order.
+    QVector<QLine> lines;
+    QVector<QRect> rects;
+    auto flush = [&](){
+        if(!lines.isEmpty()){
+            painter->drawLines(lines);
+            lines.clear();
+        }
+        if(!rects.isEmpty()){
+            painter->drawRects(rects);
+            rects.clear();
+        }
+    };
+
+    for(const Shape* shape : shapes){
+        if(!styled || !shape->hasSameStyle(styled)){
+            flush();
+            painter->setPen(shape->pen());
+            painter->setBrush(shape->brush());
+        }
+        styled = shape;
+
+        if(isBatchable(shape)){
+            if(shape->type() == Shape::Type::Line){
+                if(!rects.isEmpty())
+                    flush();
+                const LineShape* line = static_cast<const LineShape*>(shape);
+                lines.append(QLine(line->startPoint(), line->endPoint()));
+            }
+            else{
+                if(!lines.isEmpty())
+                    flush();
+                rects.append(static_cast<const RectangleShape*>(shape)->rect());
+            }
+            continue;
+        }
+
+        flush();
+        shape->drawGeometry(painter);
+        if(shape->isSelected()){
+            shape->drawSelection(painter);
+            styled = nullptr;
+        }
+    }
+    flush();
+    painter->restore();
+}
+
+void DocumentRenderer::render(const QList<Shape*>& shapes, const QRectF& source, QImage& image,
+                              const QColor& background){
+    image.fill(background);
+    if(source.isEmpty())
+        return;
+
+    QPainter painter(&image);
+    const QSizeF size = QSizeF(image.size()) / image.devicePixelRatio();
+    painter.scale(size.width() / source.width(), size.height() / source.height());
+    painter.translate(-source.topLeft());
+
+    QList<Shape*> visible;
+    for(Shape* shape : shapes){
+        if(QRectF(paintedRect(shape)).intersects(source))
+            visible.append(shape);
+    }
+    drawShapes(&painter, visible);
+}
+
+void DocumentRenderer::renderTiled(const QList<Shape*>& shapes, const QRectF& source, QImage& image,
+                                   const QColor& background, QThreadPool* pool){
+    if(source.isEmpty()){
+        image.fill(background);
+        return;
+    }
+
+    const QSizeF size = QSizeF(image.size()) / image.devicePixelRatio();
+    QTransform transform;
+    transform.scale(size.width() / source.width(), size.height() / source.height());
+    transform.translate(-source.left(), -source.top());
+    renderTiled(shapes, transform, image, image.rect(), background, pool);
+}
+
+void DocumentRenderer::renderTiled(const QList<Shape*>& shapes, const QTransform& transform, QImage& image,
+                                   const QRect& area, const QColor& background, QThreadPool* pool){
+    const QRect target = area & image.rect();
+    if(target.isEmpty() || image.depth() < 8)
+        return;
+
+    const qreal dpr = image.devicePixelRatio();
+    const int columns = (target.width() + TileSize - 1) / TileSize;
+    const int rows = (target.height() + TileSize - 1) / TileSize;
+    const int tileCount = columns * rows;
+
+    // Bins every shape into the tiles its painted area covers; shapes keep
+    // their order inside a bin. Bounds and lazy caches are only touched here,
+    // on the calling thread, so the workers do nothing but draw.
+    QTransform device = transform;
+    device *= QTransform::fromScale(dpr, dpr);
+    QVector<QVector<Shape*>> bins(tileCount);
+    for(Shape* shape : shapes){
+        const QRect covered = device.mapRect(QRectF(paintedRect(shape))).toAlignedRect() & target;
+        if(covered.isEmpty())
+            continue;
+        shape->prepareDraw(device);
+        const int firstColumn = (covered.left() - target.left()) / TileSize;
+        const int lastColumn = (covered.right() - target.left()) / TileSize;
+        const int firstRow = (covered.top() - target.top()) / TileSize;
+        const int lastRow = (covered.bottom() - target.top()) / TileSize;
+        for(int row = firstRow; row <= lastRow; ++row){
+            for(int column = firstColumn; column <= lastColumn; ++column)
+                bins[row * columns + column].append(shape);
+        }
+    }
+
+    // Tiles are views into the image's own buffer, so there is nothing to
+    // copy back: neighbouring tiles never share a pixel
+    uchar* bits = image.bits();
+    const qsizetype bytesPerLine = image.bytesPerLine();
+    const int bytesPerPixel = image.depth() / 8;
+    const QImage::Format format = image.format();
+
+    QAtomicInt next(0);
+    auto drawTiles = [&](){
+        for(int tile = next.fetchAndAddRelaxed(1); tile < tileCount; tile = next.fetchAndAddRelaxed(1)){
+            const QRect rect = QRect(target.left() + (tile % columns) * TileSize,
+                                     target.top() + (tile / columns) * TileSize,
+                                     TileSize, TileSize) & target;
+            QImage view(bits + rect.top() * bytesPerLine + rect.left() * bytesPerPixel,
+                        rect.width(), rect.height(), bytesPerLine, format);
+
+            QPainter painter(&view);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            painter.fillRect(view.rect(), background);
+            painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+            painter.setTransform(device * QTransform::fromTranslate(-rect.left(), -rect.top()));
+            drawShapes(&painter, bins[tile]);
+        }
+    };
+
+    if(!pool)
+        pool = QThreadPool::globalInstance();
+    const int helperCount = qMin(tileCount, pool->maxThreadCount()) - 1;
+    if(helperCount <= 0){
+        drawTiles();
+        return;
+    }
+
+    // Helpers still queued when the caller runs out of tiles are taken back
+    // rather than waited for, so a busy pool only costs parallelism
+    QSemaphore done;
+    QVector<QRunnable*> helpers;
+    helpers.reserve(helperCount);
+    for(int i = 0; i < helperCount; ++i){
+        QRunnable* helper = QRunnable::create([&](){
+            drawTiles();
+            done.release();
+        });
+        helper->setAutoDelete(false);
+        helpers.append(helper);
+        pool->start(helper);
+    }
+    drawTiles();
+    for(QRunnable* helper : helpers){
+        if(pool->tryTake(helper))
+            done.release();
+    }
+    done.acquire(helperCount);
+    qDeleteAll(helpers);
+}
@@ -0,0 +1,73 @@
+#include "../include/DocumentSaver.h"
+#include <QFileInfo>
+
+DocumentSaver::DocumentSaver(QObject* parent) : QObject(parent), m_lastOk(1){
+    // A single writer keeps saves of the same file from overtaking each other
+    m_pool.setMaxThreadCount(1);
+}
+
+DocumentSaver::~DocumentSaver(){
+    m_pool.waitForDone();
+}
+
+bool DocumentSaver::start(const DocumentSnapshot& snapshot, const QString& fileName){
+    if(!canWrite(fileName))
+        return false;
+
+    ++m_running;
+    m_pool.start([this, snapshot, fileName](){
+        bool ok = write(snapshot, fileName);
+        m_lastOk.storeRelease(ok ? 1 : 0);
+
+        QMetaObject::invokeMethod(this, [this, fileName, ok](){
+            --m_running;
+            emit finished(fileName, ok);
+        }, Qt::QueuedConnection);
+    });
+    return true;
+}
+
+bool DocumentSaver::isSaving() const{
+    return m_running > 0;
+}
+
+bool DocumentSaver::waitForFinished(){
+    m_pool.waitForDone();
+    return m_lastOk.loadAcquire() != 0;
+}
+
+// The checks QSaveFile makes before it creates its temporary file
+bool DocumentSaver::canWrite(const QString& fileName){
+    QFileInfo file(fileName);
+    if(file.exists() && (file.isDir() || !file.isWritable()))
+        return false;
+    QFileInfo directory(file.absolutePath());
+    return directory.isDir() && directory.isWritable();
+}
+
+bool DocumentSaver::write(const DocumentSnapshot& snapshot, const QString& fileName){
+    if(DocumentIO::formatForFile(fileName) == DocumentIO::Format::Binary){
+        QVector<DocumentIO::Record> records;
+        records.reserve(snapshot.items.size());
+        for(const DocumentSnapshot::Item& item : snapshot.items)
+            records.append(item.shape ? DocumentIO::encodeRecord(item.shape.data()) : item.record);
+        return DocumentIO::save(records, fileName);
+    }
+
+    // JSON is written from shape state; only records nobody decoded yet are decoded for it
+    QList<Shape*> shapes;
+    QVector<QSharedPointer<Shape>> decoded;
+    shapes.reserve(snapshot.items.size());
+    for(const DocumentSnapshot::Item& item : snapshot.items){
+        if(item.shape){
+            shapes.append(item.shape.data());
+            continue;
+        }
+        QSharedPointer<Shape> shape(DocumentIO::decodeRecord(item.record));
+        if(!shape)
+            return false;
+        decoded.append(shape);
+        shapes.append(shape.data());
+    }
+    return DocumentIO::save(shapes, fileName);
+}
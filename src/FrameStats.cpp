@@ -0,0 +1,198 @@
+#include "../include/FrameStats.h"
+
+#ifdef PAINT_INSTRUMENTATION
+
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QTextStream>
+#include <algorithm>
+
+static const QSize HudSize(260, 92);
+
+// Nearest-rank percentile of values, which gets sorted
+static qint64 percentile(QVector<qint64>& values, double p){
+    if(values.isEmpty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    int index = qBound(0, int(p * values.size() + 0.5) - 1, values.size() - 1);
+    return values[index];
+}
+
+static QString formatMs(qint64 ns){
+    return QString::number(ns / 1e6, 'f', 2);
+}
+
+FrameStats::FrameStats(){
+    m_clock.start();
+}
+
+qint64 FrameStats::now() const{
+    return m_clock.nsecsElapsed();
+}
+
+void FrameStats::markInput(){
+    if(m_pendingInput < 0)
+        m_pendingInput = now();
+}
+
+void FrameStats::beginFrame(){
+    m_current = Frame();
+    m_current.start = now();
+    m_current.latency = -1;
+    m_inFrame = true;
+}
+
+void FrameStats::addVisited(int count){
+    if(m_inFrame)
+        m_current.visited += count;
+}
+
+void FrameStats::addDrawn(int count){
+    if(m_inFrame)
+        m_current.drawn += count;
+}
+
+void FrameStats::endFrame(){
+    if(!m_inFrame)
+        return;
+
+    qint64 end = now();
+    m_current.duration = end - m_current.start;
+    if(m_pendingInput >= 0){
+        m_current.latency = end - m_pendingInput;
+        m_pendingInput = -1;
+    }
+    m_frames.push(m_current);
+    m_inFrame = false;
+}
+
+void FrameStats::recordSelection(qint64 start, int candidates){
+    m_selections.push({start, now() - start, candidates});
+}
+
+bool FrameStats::isHudVisible() const{
+    return m_hudVisible;
+}
+
+void FrameStats::setHudVisible(bool visible){
+    m_hudVisible = visible;
+}
+
+QRect FrameStats::hudRect() const{
+    return QRect(QPoint(8, 8), HudSize);
+}
+
+void FrameStats::drawHud(QPainter* painter) const{
+    const QVector<Frame> frames = m_frames.snapshot();
+    const QVector<Selection> selections = m_selections.snapshot();
+
+    QVector<qint64> paint;
+    QVector<qint64> latency;
+    QVector<qint64> select;
+    qint64 visited = 0;
+    qint64 drawn = 0;
+    for(const Frame& frame : frames){
+        paint.append(frame.duration);
+        if(frame.latency >= 0)
+            latency.append(frame.latency);
+        visited += frame.visited;
+        drawn += frame.drawn;
+    }
+    for(const Selection& selection : selections)
+        select.append(selection.duration);
+
+    auto row = [](const QString& label, QVector<qint64>& values){
+        return label + QString("  p50 %1  p95 %2  p99 %3 ms")
+            .arg(formatMs(percentile(values, 0.50)))
+            .arg(formatMs(percentile(values, 0.95)))
+            .arg(formatMs(percentile(values, 0.99)));
+    };
+
+    QStringList lines;
+    lines << QString("frames %1  shapes drawn/visited %2/%3")
+             .arg(frames.size()).arg(drawn).arg(visited);
+    lines << row("paint  ", paint);
+    lines << row("latency", latency);
+    lines << row("select ", select);
+
+    painter->save();
+    painter->setPen(Qt::NoPen);
+    painter->setBrush(QColor(0, 0, 0, 180));
+    painter->drawRect(hudRect());
+    painter->setPen(Qt::white);
+    painter->setFont(QFont("monospace", 8));
+    painter->drawText(hudRect().adjusted(6, 4, -6, -4), Qt::AlignLeft | Qt::AlignVCenter, lines.join('\n'));
+    painter->restore();
+}
+
+bool FrameStats::dump(const QString& fileName) const{
+    if(QFileInfo(fileName).suffix().compare("json", Qt::CaseInsensitive) == 0)
+        return dumpChromeTrace(fileName);
+    return dumpCsv(fileName);
+}
+
+bool FrameStats::dumpCsv(const QString& fileName) const{
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+
+    QTextStream out(&file);
+    out << "event,start_us,duration_us,visited,drawn,latency_us\n";
+    for(const Frame& frame : m_frames.snapshot()){
+        out << "paint," << frame.start / 1000 << ',' << frame.duration / 1000 << ','
+            << frame.visited << ',' << frame.drawn << ','
+            << (frame.latency >= 0 ? QString::number(frame.latency / 1000) : QString()) << '\n';
+    }
+    for(const Selection& selection : m_selections.snapshot()){
+        out << "select," << selection.start / 1000 << ',' << selection.duration / 1000 << ','
+            << selection.candidates << ",,\n";
+    }
+    out.flush();
+    return file.error() == QFileDevice::NoError;
+}
+
+bool FrameStats::dumpChromeTrace(const QString& fileName) const{
+    // Complete ("X") events in microseconds, one track per kind of sample;
+    // loads in chrome://tracing and Perfetto
+    auto event = [](const QString& name, int track, qint64 start, qint64 duration){
+        QJsonObject object;
+        object["name"] = name;
+        object["ph"] = "X";
+        object["pid"] = 1;
+        object["tid"] = track;
+        object["ts"] = start / 1000.0;
+        object["dur"] = duration / 1000.0;
+        return object;
+    };
+
+    QJsonArray events;
+    for(const Frame& frame : m_frames.snapshot()){
+        QJsonObject paint = event("paint", 1, frame.start, frame.duration);
+        paint["args"] = QJsonObject{{"visited", frame.visited}, {"drawn", frame.drawn}};
+        events.append(paint);
+        if(frame.latency >= 0){
+            qint64 end = frame.start + frame.duration;
+            events.append(event("input to present", 2, end - frame.latency, frame.latency));
+        }
+    }
+    for(const Selection& selection : m_selections.snapshot()){
+        QJsonObject select = event("selectShape", 3, selection.start, selection.duration);
+        select["args"] = QJsonObject{{"candidates", selection.candidates}};
+        events.append(select);
+    }
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ms";
+    QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Compact);
+    return file.write(json) == json.size();
+}
+
+#endif
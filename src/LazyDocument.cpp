@@ -0,0 +1,74 @@
+#include "../include/LazyDocument.h"
+
+LazyDocument::~LazyDocument(){
+    if(m_data)
+        m_file.unmap(reinterpret_cast<uchar*>(const_cast<char*>(m_data)));
+}
+
+LazyDocument* LazyDocument::open(const QString& fileName){
+    LazyDocument* document = new LazyDocument();
+    document->m_file.setFileName(fileName);
+    if(!document->m_file.open(QIODevice::ReadOnly) || document->m_file.size() == 0){
+        delete document;
+        return nullptr;
+    }
+
+    document->m_size = document->m_file.size();
+    document->m_data = reinterpret_cast<const char*>(document->m_file.map(0, document->m_size));
+    if(!document->m_data
+        || !DocumentIO::scanBinary(document->m_data, document->m_size, document->m_records)){
+        delete document;
+        return nullptr;
+    }
+
+    for(int i = 0; i < document->m_records.size(); ++i){
+        const DocumentIO::BinaryRecord& record = document->m_records[i];
+        if(DocumentIO::isKnownType(record.type))
+            document->m_pending.insert(i, record.bounds, i);
+    }
+    return document;
+}
+
+int LazyDocument::recordCount() const{
+    return m_records.size();
+}
+
+int LazyDocument::pendingCount() const{
+    return m_pending.size();
+}
+
+QVector<int> LazyDocument::take(const QRect& rect){
+    QVector<int> records = m_pending.query(rect);
+    for(int record : records)
+        m_pending.remove(record);
+    return records;
+}
+
+QVector<int> LazyDocument::takeAll(){
+    QVector<int> records = pendingRecords();
+    m_pending.clear();
+    return records;
+}
+
+Shape* LazyDocument::decode(int record) const{
+    return DocumentIO::decodeRecord(m_data, m_records[record]);
+}
+
+QVector<int> LazyDocument::pendingRecords() const{
+    QVector<int> records;
+    records.reserve(m_pending.size());
+    for(int i = 0; i < m_records.size(); ++i){
+        if(m_pending.contains(i))
+            records.append(i);
+    }
+    return records;
+}
+
+DocumentIO::Record LazyDocument::record(int record) const{
+    const DocumentIO::BinaryRecord& location = m_records[record];
+    return {location.type, location.bounds, QByteArray::fromRawData(m_data + location.offset, int(location.length))};
+}
+
+QString LazyDocument::fileName() const{
+    return m_file.fileName();
+}
@@ -1,4 +1,5 @@
 #include "../include/MainWindow.h"
+#include "../include/DocumentJournal.h"
 #include <QFileDialog>
 #include <QColorDialog>
 #include <QMessageBox>
@@ -9,6 +10,8 @@
 #include <QMenuBar>
 #include <QActionGroup>
 #include <QCloseEvent>
+#include <QSettings>
+#include <QTimer>
 
 MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent){
     m_canvas = new CanvasWidget(this);
@@ -22,13 +25,25 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent){
 
     connect(m_canvas, &CanvasWidget::shapeSelected, this, &MainWindow::updateStatusBar);
     connect(m_canvas, &CanvasWidget::fileModified, [this](bool modified){setWindowModified(modified);});
+    connect(m_canvas, &CanvasWidget::saveFinished, this, &MainWindow::handleSaveFinished);
+    connect(m_canvas, &CanvasWidget::zoomChanged, this, [this](qreal zoom){
+        statusBar()->showMessage(QString("Zoom %1%").arg(qRound(zoom * 100)), 2000);
+    });
     
     setWindowTitle("Paint App[*]");
     resize(800, 600);
+
+    // Offer the journal of a document left open by a crash once the window is up
+    QTimer::singleShot(0, this, &MainWindow::recoverSession);
 }
 
 void MainWindow::closeEvent(QCloseEvent* event){
-    if(maybeSave()){
+    // A save started earlier may still be writing; closing is only safe once it is on disk
+    if(m_canvas->waitForSave() && maybeSave()){
+        // Changes the user chose to discard must not come back from the journal
+        if(isWindowModified())
+            m_canvas->newDocument();
+        setSessionDocument(QString());
         event->accept();
     }
     else{
@@ -38,8 +53,9 @@ void MainWindow::closeEvent(QCloseEvent* event){
 
 void MainWindow::newFile(){
     if (maybeSave()) {
-        m_canvas->clearCanvas();
+        m_canvas->newDocument();
         m_currentFile.clear();
+        setSessionDocument(QString());
         setWindowTitle("Paint App");
         setWindowModified(false);
     }
@@ -47,13 +63,14 @@ void MainWindow::newFile(){
 
 void MainWindow::open(){
     if(maybeSave()){
-        QString fileName = QFileDialog::getOpenFileName(this, "Open file", "", "Paint Files (*.paint)");
+        QString fileName = QFileDialog::getOpenFileName(this, "Open file", "", "Paint Files (*.paint *.paintb)");
         if(!fileName.isEmpty()){
-            if(m_canvas->loadFromFile(fileName)){
+            if(loadFile(fileName)){
                 m_currentFile = fileName;
                 setWindowTitle(QFileInfo(fileName).fileName() + " - Paint App");
+                setSessionDocument(fileName);
             }
-            else{
+            else if(!m_canvas->loadCancelled()){
                 QMessageBox::warning(this, "Warning", "Failed to open file");
             }
         }
@@ -65,20 +82,24 @@ bool MainWindow::save(){
         return saveAs();
     }
     else{
-        return m_canvas->saveToFile(m_currentFile);
+        return saveFile(m_currentFile);
     }
 }
 
 bool MainWindow::saveAs(){
+    const QString jsonFilter = "Paint Files (*.paint)";
+    const QString binaryFilter = "Paint Binary Files (*.paintb)";
+    QString selectedFilter = jsonFilter;
     QString fileName = QFileDialog::getSaveFileName(this,
-        "Save File", "", "Paint Files (*.paint)");
+        "Save File", "", jsonFilter + ";;" + binaryFilter, &selectedFilter);
     if (!fileName.isEmpty()) {
-        if (!fileName.endsWith(".paint")) {
-            fileName += ".paint";
+        if (!fileName.endsWith(".paint") && !fileName.endsWith(".paintb")) {
+            fileName += selectedFilter == binaryFilter ? ".paintb" : ".paint";
         }
         if (saveFile(fileName)) {
             m_currentFile = fileName;
             setWindowTitle(QFileInfo(fileName).fileName() + " - Paint App");
+            setSessionDocument(fileName);
             return true;
         }
     }
@@ -125,6 +146,25 @@ void MainWindow::showShapeProperties(){
     QMessageBox::information(this, "Propertiers", "The properties of the selected figure will be here");
 }
 
+#ifdef PAINT_INSTRUMENTATION
+void MainWindow::dumpFrameStats(){
+    const QString csvFilter = "CSV (*.csv)";
+    const QString traceFilter = "Chrome trace (*.json)";
+    QString selectedFilter = csvFilter;
+    QString fileName = QFileDialog::getSaveFileName(this,
+        "Dump frame statistics", "", csvFilter + ";;" + traceFilter, &selectedFilter);
+    if (fileName.isEmpty()) {
+        return;
+    }
+    if (!fileName.endsWith(".csv") && !fileName.endsWith(".json")) {
+        fileName += selectedFilter == traceFilter ? ".json" : ".csv";
+    }
+    if (!m_canvas->dumpFrameStats(fileName)) {
+        QMessageBox::warning(this, "Warning", "Failed to write frame statistics");
+    }
+}
+#endif
+
 void MainWindow::updateStatusBar(const QString& message){
     statusBar()->showMessage(message);
 }
@@ -190,6 +230,12 @@ void MainWindow::createActions(){
     m_fillColorAct = new QAction("Fill color...", this);
     connect(m_fillColorAct, &QAction::triggered, this, &MainWindow::selectFillColor);
     
+    m_undoAct = m_canvas->undoStack()->createUndoAction(this, "Undo");
+    m_undoAct->setShortcut(QKeySequence::Undo);
+
+    m_redoAct = m_canvas->undoStack()->createRedoAction(this, "Redo");
+    m_redoAct->setShortcut(QKeySequence::Redo);
+
     m_deleteAct = new QAction("Delete", this);
     m_deleteAct->setShortcut(QKeySequence::Delete);
     connect(m_deleteAct, &QAction::triggered, m_canvas, &CanvasWidget::deleteSelectedShape);
@@ -203,9 +249,31 @@ void MainWindow::createActions(){
     m_sendToBackAct = new QAction("Bring to back", this);
     connect(m_sendToBackAct, &QAction::triggered, m_canvas, &CanvasWidget::sendToBack);
     
+    m_zoomInAct = new QAction("Zoom in", this);
+    m_zoomInAct->setShortcut(QKeySequence::ZoomIn);
+    connect(m_zoomInAct, &QAction::triggered, m_canvas, &CanvasWidget::zoomIn);
+
+    m_zoomOutAct = new QAction("Zoom out", this);
+    m_zoomOutAct->setShortcut(QKeySequence::ZoomOut);
+    connect(m_zoomOutAct, &QAction::triggered, m_canvas, &CanvasWidget::zoomOut);
+
+    m_resetViewAct = new QAction("Actual size", this);
+    m_resetViewAct->setShortcut(Qt::CTRL | Qt::Key_0);
+    connect(m_resetViewAct, &QAction::triggered, m_canvas, &CanvasWidget::resetView);
+
     m_aboutAct = new QAction("About", this);
     connect(m_aboutAct, &QAction::triggered, this, &MainWindow::about);
 
+#ifdef PAINT_INSTRUMENTATION
+    m_statsHudAct = new QAction("Frame statistics", this);
+    m_statsHudAct->setShortcut(Qt::Key_F12);
+    m_statsHudAct->setCheckable(true);
+    connect(m_statsHudAct, &QAction::toggled, m_canvas, &CanvasWidget::setStatsHudVisible);
+
+    m_dumpStatsAct = new QAction("Dump frame statistics...", this);
+    connect(m_dumpStatsAct, &QAction::triggered, this, &MainWindow::dumpFrameStats);
+#endif
+
     m_lineAct->setToolTip("Draw straight lines");
     m_freehandAct->setToolTip("Draw freehand lines");
     m_rectAct->setToolTip("Draw rectangles");
@@ -228,6 +296,9 @@ void MainWindow::createMenus(){
     m_fileMenu->addAction(m_exitAct);
     
     m_editMenu = menuBar()->addMenu("Edit");
+    m_editMenu->addAction(m_undoAct);
+    m_editMenu->addAction(m_redoAct);
+    m_editMenu->addSeparator();
     m_editMenu->addAction(m_deleteAct);
     m_editMenu->addAction(m_propertiesAct);
     m_editMenu->addSeparator();
@@ -235,6 +306,14 @@ void MainWindow::createMenus(){
     m_editMenu->addAction(m_sendToBackAct);
     
     m_viewMenu = menuBar()->addMenu("View");
+    m_viewMenu->addAction(m_zoomInAct);
+    m_viewMenu->addAction(m_zoomOutAct);
+    m_viewMenu->addAction(m_resetViewAct);
+#ifdef PAINT_INSTRUMENTATION
+    m_viewMenu->addSeparator();
+    m_viewMenu->addAction(m_statsHudAct);
+    m_viewMenu->addAction(m_dumpStatsAct);
+#endif
     
     m_helpMenu = menuBar()->addMenu("Help");
     m_helpMenu->addAction(m_aboutAct);
@@ -265,6 +344,9 @@ void MainWindow::createToolBars()
     m_drawingToolBar->addWidget(widthSpinBox);
     
     m_editToolBar = addToolBar("Editing");
+    m_editToolBar->addAction(m_undoAct);
+    m_editToolBar->addAction(m_redoAct);
+    m_editToolBar->addSeparator();
     m_editToolBar->addAction(m_deleteAct);
     m_editToolBar->addAction(m_propertiesAct);
     m_editToolBar->addSeparator();
@@ -287,17 +369,64 @@ bool MainWindow::maybeSave(){
         QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel);
     
     if (ret == QMessageBox::Save) {
-        return save();
+        // The window may go away next, so this save has to be on disk first
+        return save() && m_canvas->waitForSave();
     } else if (ret == QMessageBox::Cancel) {
         return false;
     }
     return true;
 }
 
+// Failures after the save started arrive through handleSaveFinished()
 bool MainWindow::saveFile(const QString &fileName){
-    return m_canvas->saveToFile(fileName);
+    if(!m_canvas->saveToFile(fileName)){
+        QMessageBox::warning(this, "Warning", "Cannot write " + QFileInfo(fileName).fileName());
+        return false;
+    }
+    return true;
+}
+
+void MainWindow::handleSaveFinished(const QString& fileName, bool ok){
+    if(ok){
+        statusBar()->showMessage("Saved " + QFileInfo(fileName).fileName(), 2000);
+    }
+    else{
+        QMessageBox::warning(this, "Warning", "Failed to save " + QFileInfo(fileName).fileName());
+    }
 }
 
 bool MainWindow::loadFile(const QString &fileName){
+    if(fileName != m_currentFile && DocumentJournal::canRecover(fileName)){
+        QMessageBox::StandardButton ret = QMessageBox::question(this, "Paint App",
+            QFileInfo(fileName).fileName() + " has changes that were not saved.\nRecover them?",
+            QMessageBox::Yes | QMessageBox::No);
+        if(ret == QMessageBox::Yes){
+            return m_canvas->recoverFile(fileName);
+        }
+    }
     return m_canvas->loadFromFile(fileName);
+}
+
+void MainWindow::recoverSession(){
+    QString fileName = QSettings().value("session/document").toString();
+    if(fileName.isEmpty() || !DocumentJournal::canRecover(fileName)){
+        return;
+    }
+
+    if(loadFile(fileName)){
+        m_currentFile = fileName;
+        setWindowTitle(QFileInfo(fileName).fileName() + " - Paint App");
+    }
+}
+
+// Remembers the open document until the window closes normally, so its
+// journal can be found after a crash
+void MainWindow::setSessionDocument(const QString& fileName){
+    QSettings settings;
+    if(fileName.isEmpty()){
+        settings.remove("session/document");
+    }
+    else{
+        settings.setValue("session/document", fileName);
+    }
 } 
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include "../include/SpatialIndex.h"
+#include <algorithm>
+
+// Items covering more cells than this are kept in a flat list instead
+static const int MaxCellsPerItem = 64;
+
+template <typename T>
+SpatialIndex<T>::SpatialIndex(int cellSize) : m_cellSize(qMax(1, cellSize)) {}
+
+template <typename T>
+void SpatialIndex<T>::insert(T item, const QRect& rect, qint64 z){
+    if(m_slots.contains(item))
+        remove(item);
+
+    int slot = m_items.size();
+    m_items.append(item);
+    m_rects.append(rect);
+    m_z.append(z);
+    m_slots.insert(item, slot);
+    addToCells(slot, cellRange(rect));
+}
+
+template <typename T>
+void SpatialIndex<T>::update(T item, const QRect& rect){
+    auto it = m_slots.constFind(item);
+    if(it == m_slots.cend())
+        return;
+
+    int slot = it.value();
+    if(m_rects[slot] == rect)
+        return;
+
+    QRect oldCells = cellRange(m_rects[slot]);
+    QRect newCells = cellRange(rect);
+    m_rects[slot] = rect;
+    if(oldCells != newCells){
+        removeFromCells(slot, oldCells);
+        addToCells(slot, newCells);
+    }
+}
+
+template <typename T>
+void SpatialIndex<T>::setZ(T item, qint64 z){
+    auto it = m_slots.constFind(item);
+    if(it != m_slots.cend())
+        m_z[it.value()] = z;
+}
+
+template <typename T>
+void SpatialIndex<T>::remove(T item){
+    auto it = m_slots.find(item);
+    if(it == m_slots.end())
+        return;
+
+    int slot = it.value();
+    m_slots.erase(it);
+    removeFromCells(slot, cellRange(m_rects[slot]));
+
+    int last = m_items.size() - 1;
+    if(slot != last){
+        QRect lastCells = cellRange(m_rects[last]);
+        removeFromCells(last, lastCells);
+        m_items[slot] = m_items[last];
+        m_rects[slot] = m_rects[last];
+        m_z[slot] = m_z[last];
+        m_slots[m_items[slot]] = slot;
+        addToCells(slot, lastCells);
+    }
+
+    m_items.removeLast();
+    m_rects.removeLast();
+    m_z.removeLast();
+}
+
+template <typename T>
+void SpatialIndex<T>::clear(){
+    m_items.clear();
+    m_rects.clear();
+    m_z.clear();
+    m_slots.clear();
+    m_cells.clear();
+    m_oversized.clear();
+}
+
+template <typename T>
+bool SpatialIndex<T>::contains(T item) const{
+    return m_slots.contains(item);
+}
+
+template <typename T>
+QRect SpatialIndex<T>::rect(T item) const{
+    auto it = m_slots.constFind(item);
+    return it == m_slots.cend() ? QRect() : m_rects[it.value()];
+}
+
+template <typename T>
+qint64 SpatialIndex<T>::z(T item) const{
+    auto it = m_slots.constFind(item);
+    return it == m_slots.cend() ? 0 : m_z[it.value()];
+}
+
+template <typename T>
+int SpatialIndex<T>::size() const{
+    return m_items.size();
+}
+
+template <typename T>
+QVector<T> SpatialIndex<T>::query(const QRect& rect) const{
+    QVector<T> result;
+    if(rect.isEmpty() || m_items.isEmpty())
+        return result;
+
+    QVector<int> hits;
+    auto collect = [&](const QVector<int>& slots){
+        for(int slot : slots){
+            if(m_rects[slot].intersects(rect))
+                hits.append(slot);
+        }
+    };
+
+    QRect cells = cellRange(rect);
+    if(qint64(cells.width()) * cells.height() > m_cells.size()){
+        // Query covers more cells than are occupied, walk the occupied ones instead
+        for(auto it = m_cells.cbegin(); it != m_cells.cend(); ++it){
+            if(cells.contains(cellPos(it.key())))
+                collect(it.value());
+        }
+    }
+    else{
+        for(int y = cells.top(); y <= cells.bottom(); ++y){
+            for(int x = cells.left(); x <= cells.right(); ++x){
+                auto it = m_cells.constFind(cellKey(x, y));
+                if(it != m_cells.cend())
+                    collect(it.value());
+            }
+        }
+    }
+    for(int slot : m_oversized){
+        if(m_rects[slot].intersects(rect))
+            hits.append(slot);
+    }
+
+    std::sort(hits.begin(), hits.end(), [this](int a, int b){
+        return m_z[a] != m_z[b] ? m_z[a] < m_z[b] : a < b;
+    });
+    hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+
+    result.reserve(hits.size());
+    for(int slot : hits)
+        result.append(m_items[slot]);
+    return result;
+}
+
+template <typename T>
+QVector<T> SpatialIndex<T>::query(const QPoint& point) const{
+    return query(QRect(point, QSize(1, 1)));
+}
+
+template <typename T>
+QRect SpatialIndex<T>::cellRange(const QRect& rect) const{
+    if(rect.isEmpty())
+        return QRect();
+    return QRect(QPoint(cellCoord(rect.left(), m_cellSize), cellCoord(rect.top(), m_cellSize)),
+                 QPoint(cellCoord(rect.right(), m_cellSize), cellCoord(rect.bottom(), m_cellSize)));
+}
+
+template <typename T>
+bool SpatialIndex<T>::isOversized(const QRect& cells) const{
+    return qint64(cells.width()) * cells.height() > MaxCellsPerItem;
+}
+
+template <typename T>
+void SpatialIndex<T>::addToCells(int slot, const QRect& cells){
+    if(cells.isEmpty())
+        return;
+    if(isOversized(cells)){
+        m_oversized.insert(slot);
+        return;
+    }
+    for(int y = cells.top(); y <= cells.bottom(); ++y){
+        for(int x = cells.left(); x <= cells.right(); ++x){
+            m_cells[cellKey(x, y)].append(slot);
+        }
+    }
+}
+
+template <typename T>
+void SpatialIndex<T>::removeFromCells(int slot, const QRect& cells){
+    if(cells.isEmpty())
+        return;
+    if(isOversized(cells)){
+        m_oversized.remove(slot);
+        return;
+    }
+    for(int y = cells.top(); y <= cells.bottom(); ++y){
+        for(int x = cells.left(); x <= cells.right(); ++x){
+            auto it = m_cells.find(cellKey(x, y));
+            if(it == m_cells.end())
+                continue;
+            it->removeOne(slot);
+            if(it->isEmpty())
+                m_cells.erase(it);
+        }
+    }
+}
+
+template <typename T>
+int SpatialIndex<T>::cellCoord(int value, int cellSize){
+    return value >= 0 ? value / cellSize : -((-value - 1) / cellSize) - 1;
+}
+
+template <typename T>
+quint64 SpatialIndex<T>::cellKey(int x, int y){
+    return (quint64(quint32(x)) << 32) | quint32(y);
+}
+
+template <typename T>
+QPoint SpatialIndex<T>::cellPos(quint64 key){
+    return QPoint(int(quint32(key >> 32)), int(quint32(key & 0xffffffffu)));
+}
+
+template class SpatialIndex<Shape*>;
+template class SpatialIndex<int>;
@@ -4,6 +4,8 @@
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    a.setOrganizationName("Paint");
+    a.setApplicationName("Paint App");
     MainWindow w;
     w.show();
     return a.exec();
@@ -1,4 +1,6 @@
 #include "../../include/shapes/EllipseShape.h"
+#include "../../include/BinaryStream.h"
+#include <QtMath>
 
 EllipseShape::EllipseShape(const QRect& rect, QObject* parent) :
     Shape(parent), m_rect(rect) {}
@@ -6,58 +8,33 @@ EllipseShape::EllipseShape(const QRect& rect, QObject* parent) :
 EllipseShape::EllipseShape(const QPoint& center, int rx, int ry, QObject* parent) :
     Shape(parent), m_rect(center.x() - rx, center.y() - ry, rx * 2, ry * 2) {}
 
-void EllipseShape::draw(QPainter* painter){
-    painter->save();
-
-    QPen pen(m_penColor, m_penWidth, m_penStyle);
-    pen.setCapStyle(Qt::RoundCap);
-    pen.setJoinStyle(Qt::RoundJoin);
-    painter->setPen(pen);
-    painter->setBrush(m_fillColor);
-
+void EllipseShape::drawGeometry(QPainter* painter) const{
     if (qFuzzyIsNull(m_rotationAngle)) {
         painter->drawEllipse(m_rect);
     } else {
-        painter->translate(rotationCenter());
-        painter->rotate(m_rotationAngle);
-        painter->translate(-rotationCenter());
+        // Rotate on top of the caller's transform, not instead of it
+        const QTransform transform = painter->worldTransform();
+        painter->setWorldTransform(rotationTransform(), true);
         painter->drawEllipse(m_rect);
-        painter->resetTransform();
+        painter->setWorldTransform(transform);
     }
+}
 
-    if (m_selected) {
-        QRect selectionRect = axisAlignedBoundingRect().adjusted(-m_penWidth, -m_penWidth, m_penWidth, m_penWidth);
-        
-        painter->setPen(QPen(Qt::blue, 2, Qt::DashLine));
-        painter->setBrush(Qt::NoBrush);
-        painter->drawRect(selectionRect);
+void EllipseShape::drawSelection(QPainter* painter) const{
+    QRect selectionRect = axisAlignedBoundingRect().adjusted(-m_penWidth, -m_penWidth, m_penWidth, m_penWidth);
 
-        painter->setPen(QPen(Qt::red, 2));
-        painter->setBrush(Qt::white);
-        
-        QRectF rect = m_rect;
-        if (!qFuzzyIsNull(m_rotationAngle)) {
-            QPolygonF poly = rotatedPolygon();
-            QPointF top = (poly[0] + poly[1]) / 2;
-            QPointF right = (poly[1] + poly[2]) / 2;
-            QPointF bottom = (poly[2] + poly[3]) / 2;
-            QPointF left = (poly[3] + poly[0]) / 2;
-            
-            painter->drawEllipse(top, 4, 4);
-            painter->drawEllipse(right, 4, 4);
-            painter->drawEllipse(bottom, 4, 4);
-            painter->drawEllipse(left, 4, 4);
-        } else {
-            painter->drawEllipse(rect.left(), rect.center().y(), 4, 4);
-            painter->drawEllipse(rect.right(), rect.center().y(), 4, 4);
-            painter->drawEllipse(rect.center().x(), rect.top(), 4, 4);
-            painter->drawEllipse(rect.center().x(), rect.bottom(), 4, 4);
-        }
-        
-        painter->drawEllipse(rotationCenter(), 6, 6);
+    painter->setPen(QPen(Qt::blue, 2, Qt::DashLine));
+    painter->setBrush(Qt::NoBrush);
+    painter->drawRect(selectionRect);
+
+    painter->setPen(QPen(Qt::red, 2));
+    painter->setBrush(Qt::white);
+
+    for (const QPointF &handle : handlePoints()) {
+        painter->drawEllipse(handle, 4, 4);
     }
 
-    painter->restore();
+    painter->drawEllipse(rotationCenter(), 6, 6);
 }
 
 void EllipseShape::update(const QPoint& toPoint){
@@ -70,25 +47,8 @@ void EllipseShape::update(const QPoint& toPoint){
 
 bool EllipseShape::contains(const QPoint& point) const{
     if (m_selected) {
-        QRectF rect = m_rect;
-        if (!qFuzzyIsNull(m_rotationAngle)) {
-            QPolygonF poly = rotatedPolygon();
-            QPointF top = (poly[0] + poly[1]) / 2;
-            QPointF right = (poly[1] + poly[2]) / 2;
-            QPointF bottom = (poly[2] + poly[3]) / 2;
-            QPointF left = (poly[3] + poly[0]) / 2;
-            
-            if (QRectF(top.x() - 5, top.y() - 5, 10, 10).contains(point) ||
-                QRectF(right.x() - 5, right.y() - 5, 10, 10).contains(point) ||
-                QRectF(bottom.x() - 5, bottom.y() - 5, 10, 10).contains(point) ||
-                QRectF(left.x() - 5, left.y() - 5, 10, 10).contains(point)) {
-                return true;
-            }
-        } else {
-            if (QRectF(rect.left() - 5, rect.center().y() - 5, 10, 10).contains(point) ||
-                QRectF(rect.right() - 5, rect.center().y() - 5, 10, 10).contains(point) ||
-                QRectF(rect.center().x() - 5, rect.top() - 5, 10, 10).contains(point) ||
-                QRectF(rect.center().x() - 5, rect.bottom() - 5, 10, 10).contains(point)) {
+        for (const QPointF &handle : handlePoints()) {
+            if (QRectF(handle.x() - 5, handle.y() - 5, 10, 10).contains(point)) {
                 return true;
             }
         }
@@ -99,11 +59,7 @@ bool EllipseShape::contains(const QPoint& point) const{
         }
     }
 
-    if (qFuzzyIsNull(m_rotationAngle)) {
-        return isPointOnEllipse(point);
-    } else {
-        return rotatedPolygon().containsPoint(point, Qt::OddEvenFill);
-    }
+    return isPointOnEllipse(point);
 }
 
 void EllipseShape::move(const QPoint& offset){
@@ -112,7 +68,7 @@ void EllipseShape::move(const QPoint& offset){
 }
 
 void EllipseShape::rotate(double angle){
-    m_rotationAngle = angle;
+    m_rotationAngle += angle;
     while(m_rotationAngle >= 360.0)
         m_rotationAngle -= 360.0;
     while(m_rotationAngle < 0.0)
@@ -137,9 +93,19 @@ QRect EllipseShape::axisAlignedBoundingRect() const{
     if(qFuzzyIsNull(m_rotationAngle)){
         return m_rect;
     }
-    QPolygonF poly = rotatedPolygon();
-    QRectF rect = poly.boundingRect();
-    return rect.toRect();
+
+    // Extent of a rotated ellipse along x is sqrt(rx^2 cos^2 + ry^2 sin^2), y likewise
+    double rx = m_rect.width() / 2.0;
+    double ry = m_rect.height() / 2.0;
+    double angle = qDegreesToRadians(m_rotationAngle);
+    double c = qCos(angle);
+    double s = qSin(angle);
+    double halfWidth = qSqrt(rx * rx * c * c + ry * ry * s * s);
+    double halfHeight = qSqrt(rx * rx * s * s + ry * ry * c * c);
+
+    QPointF center = QRectF(m_rect).center();
+    return QRectF(center.x() - halfWidth, center.y() - halfHeight,
+                  2 * halfWidth, 2 * halfHeight).toAlignedRect();
 }
 
 QJsonObject EllipseShape::toJson() const{
@@ -149,6 +115,7 @@ QJsonObject EllipseShape::toJson() const{
     json["y"] = m_rect.y();
     json["width"] = m_rect.width();
     json["height"] = m_rect.height();
+    return json;
 }
 
 void EllipseShape::fromJson(const QJsonObject& json){
@@ -160,7 +127,21 @@ void EllipseShape::fromJson(const QJsonObject& json){
     if(json.contains("width"))
         m_rect.setWidth(json["width"].toInt());
     if(json.contains("height"))
-        m_rect.setWidth(json["height"].toInt());
+        m_rect.setHeight(json["height"].toInt());
+}
+
+void EllipseShape::writeBinary(BinaryWriter& out) const{
+    Shape::writeBinary(out);
+    out.writeRect(m_rect);
+}
+
+void EllipseShape::readBinary(BinaryReader& in){
+    Shape::readBinary(in);
+    m_rect = in.readRect();
+}
+
+Shape::Type EllipseShape::type() const{
+    return Type::Ellipse;
 }
 
 QString EllipseShape::name() const{ 
@@ -171,6 +152,12 @@ QPoint EllipseShape::position() const{
     return m_rect.topLeft(); 
 }
 
+Shape* EllipseShape::clone() const{
+    EllipseShape* copy = new EllipseShape(m_rect);
+    copyStyleTo(copy);
+    return copy;
+}
+
 QRect EllipseShape::rect() const{
     return m_rect;
 }
@@ -211,30 +198,44 @@ void EllipseShape::setRadiusY(int ry)
 }
 
 QPolygonF EllipseShape::rotatedPolygon() const{
-    const int points = 1024;
-    QPolygonF polygon;
-    
+    if (m_polygonCacheValid && m_polygonCacheRect == m_rect && m_polygonCacheAngle == m_rotationAngle) {
+        return m_polygonCache;
+    }
+
     double rx = m_rect.width() / 2.0;
     double ry = m_rect.height() / 2.0;
-    QPointF center = m_rect.center();
-    
+    QPointF center = QRectF(m_rect).center();
+
+    // Enough vertices to keep the chord error under a quarter pixel
+    double radius = qMax(rx, ry);
+    int points = 16;
+    if (radius > 0.25) {
+        points = qBound(16, qCeil(M_PI / qAcos(1.0 - 0.25 / radius)), 1024);
+    }
+
+    // Walk the unit circle by repeated rotation instead of cos/sin per vertex
+    double stepCos = qCos(2 * M_PI / points);
+    double stepSin = qSin(2 * M_PI / points);
+    double ux = 1.0;
+    double uy = 0.0;
+
+    QPolygonF polygon;
+    polygon.reserve(points);
     for (int i = 0; i < points; ++i) {
-        double angle = 2 * M_PI * i / points;
-        QPointF point(
-            center.x() + rx * cos(angle),
-            center.y() + ry * sin(angle)
-        );
-        polygon << point;
+        polygon << QPointF(center.x() + rx * ux, center.y() + ry * uy);
+        double nx = ux * stepCos - uy * stepSin;
+        uy = ux * stepSin + uy * stepCos;
+        ux = nx;
     }
     
     if (!qFuzzyIsNull(m_rotationAngle)) {
-        QTransform transform;
-        transform.translate(center.x(), center.y());
-        transform.rotate(m_rotationAngle);
-        transform.translate(-center.x(), -center.y());
-        polygon = transform.map(polygon);
+        polygon = rotationTransform().map(polygon);
     }
-    
+
+    m_polygonCache = polygon;
+    m_polygonCacheRect = m_rect;
+    m_polygonCacheAngle = m_rotationAngle;
+    m_polygonCacheValid = true;
     return polygon;
 }
 
@@ -242,6 +243,29 @@ QPointF EllipseShape::rotationCenter() const{
     return m_rect.center();
 }
 
+QTransform EllipseShape::rotationTransform() const{
+    QPointF center = rotationCenter();
+    QTransform transform;
+    transform.translate(center.x(), center.y());
+    transform.rotate(m_rotationAngle);
+    transform.translate(-center.x(), -center.y());
+    return transform;
+}
+
+QPolygonF EllipseShape::handlePoints() const{
+    QRectF rect = m_rect;
+    QPolygonF handles;
+    handles << QPointF(rect.center().x(), rect.top())
+            << QPointF(rect.right(), rect.center().y())
+            << QPointF(rect.center().x(), rect.bottom())
+            << QPointF(rect.left(), rect.center().y());
+
+    if (!qFuzzyIsNull(m_rotationAngle)) {
+        handles = rotationTransform().map(handles);
+    }
+    return handles;
+}
+
 bool EllipseShape::isPointOnEllipse(const QPoint& point) const{
     QPointF center = m_rect.center();
     double rx = m_rect.width() / 2.0;
@@ -252,8 +276,18 @@ bool EllipseShape::isPointOnEllipse(const QPoint& point) const{
     
     double dx = point.x() - center.x();
     double dy = point.y() - center.y();
+
+    // Undo the rotation so the ring test runs in the ellipse's own frame
+    if(!qFuzzyIsNull(m_rotationAngle)){
+        double angle = qDegreesToRadians(m_rotationAngle);
+        double c = qCos(angle);
+        double s = qSin(angle);
+        double x = dx * c + dy * s;
+        dy = -dx * s + dy * c;
+        dx = x;
+    }
     
-    double distance = qPow(dx / rx, 2) + qPow(dy / ry, 2);
+    double distance = (dx / rx) * (dx / rx) + (dy / ry) * (dy / ry);
     double minDist = qPow(1.0 - m_penWidth / (2 * qMin(rx, ry)), 2);
     double maxDist = qPow(1.0 + m_penWidth / (2 * qMin(rx, ry)), 2);
 
@@ -1,4 +1,6 @@
 #include "../../include/shapes/FreehandShape.h"
+#include "../../include/BinaryStream.h"
+#include <QtMath>
 
 FreehandShape::FreehandShape(QObject* parent) : Shape(parent) {}
 
@@ -7,49 +9,45 @@ FreehandShape::FreehandShape(const QVector<QPoint>& points, QObject* parent) :
     updateBoundingRect();
 }
 
-void FreehandShape::draw(QPainter *painter)
-{
+void FreehandShape::drawGeometry(QPainter* painter) const{
     if (m_points.size() < 2)
         return;
 
-    painter->save();
-
-    QPen pen(m_penColor, m_penWidth, m_penStyle);
-    pen.setCapStyle(Qt::RoundCap);
-    pen.setJoinStyle(Qt::RoundJoin);
-    painter->setPen(pen);
-    painter->setBrush(m_fillColor);
-
-    painter->drawPolyline(m_points.data(), m_points.size());
-
-    if (m_selected) {
-        QRect selectionRect = boundingRect().adjusted(-m_penWidth, -m_penWidth, m_penWidth, m_penWidth);
-        
-        painter->setPen(QPen(Qt::blue, 2, Qt::DashLine));
-        painter->setBrush(Qt::NoBrush);
-        painter->drawRect(selectionRect);
-
-        painter->setPen(QPen(Qt::red, 2));
-        painter->setBrush(Qt::white);
-        
-        if (!m_points.isEmpty()) {
-            painter->drawEllipse(m_points.first(), 4, 4);
-            painter->drawEllipse(m_points.last(), 4, 4);
+    const QVector<QPoint>& points = levelFor(painter->deviceTransform());
+    painter->drawPolyline(points.data(), points.size());
+}
+
+void FreehandShape::drawSelection(QPainter* painter) const{
+    if (m_points.size() < 2)
+        return;
+
+    QRect selectionRect = boundingRect().adjusted(-m_penWidth, -m_penWidth, m_penWidth, m_penWidth);
+
+    painter->setPen(QPen(Qt::blue, 2, Qt::DashLine));
+    painter->setBrush(Qt::NoBrush);
+    painter->drawRect(selectionRect);
+
+    painter->setPen(QPen(Qt::red, 2));
+    painter->setBrush(Qt::white);
+
+    painter->drawEllipse(m_points.first(), 4, 4);
+    painter->drawEllipse(m_points.last(), 4, 4);
+
+    if (m_points.size() > 10) {
+        int step = m_points.size() / 5;
+        for (int i = step; i < m_points.size(); i += step) {
+            painter->drawEllipse(m_points[i], 4, 4);
         }
-        
-        if (m_points.size() > 10) {
-            int step = m_points.size() / 5;
-            for (int i = step; i < m_points.size(); i += step) {
-                painter->drawEllipse(m_points[i], 4, 4);
-            }
-        } else {
-            for (const QPoint &p : m_points) {
-                painter->drawEllipse(p, 4, 4);
-            }
+    } else {
+        for (const QPoint &p : m_points) {
+            painter->drawEllipse(p, 4, 4);
         }
     }
+}
 
-    painter->restore();
+void FreehandShape::prepareDraw(const QTransform& deviceTransform) const{
+    if(m_points.size() >= 2)
+        levelFor(deviceTransform);
 }
 
 
@@ -73,28 +71,64 @@ QRect FreehandShape::axisAlignedBoundingRect() const{
 }
 
 void FreehandShape::update(const QPoint& toPoint){
-    m_points.append(toPoint);
-    updateBoundingRect();
+    appendPoint(toPoint);
     emit shapeChanged();
 }
 
 bool FreehandShape::contains(const QPoint& point) const{
-    if(m_selected){
-        for(const QPoint& p : m_points){
-            if(QRect(p.x() - 5, p.y() - 5, 10, 10).contains(point))
-                return true;
-        }
+    if(m_points.isEmpty())
+        return false;
+
+    if(!m_chunksValid)
+        buildChunks();
+
+    // Selected strokes also hit on the 10x10 handle around every point
+    const int margin = qMax(m_penWidth / 2 + 2, m_selected ? 5 : 0);
+    const int chunkCount = m_chunkBounds.size();
+
+    for(int g = 0; g < m_groupBounds.size(); ++g){
+        if(!m_groupBounds[g].adjusted(-margin, -margin, margin, margin).contains(point))
+            continue;
 
-        if(axisAlignedBoundingRect().adjusted(-m_penWidth, -m_penWidth, m_penWidth, m_penWidth).contains(point));
+        const int lastChunk = qMin((g + 1) * ChunkSize, chunkCount);
+        for(int c = g * ChunkSize; c < lastChunk; ++c){
+            if(!m_chunkBounds[c].adjusted(-margin, -margin, margin, margin).contains(point))
+                continue;
+
+            const int first = c * ChunkSize;
+            const int last = qMin(first + ChunkSize, int(m_points.size()) - 1);
+            if(m_selected){
+                for(int i = first; i <= last; ++i){
+                    const QPoint& p = m_points[i];
+                    if(QRect(p.x() - 5, p.y() - 5, 10, 10).contains(point))
+                        return true;
+                }
+            }
+            for(int i = first + 1; i <= last; ++i){
+                if(isPointNearSegment(point, m_points[i - 1], m_points[i]))
+                    return true;
+            }
+        }
     }
-    return isPointNearPolyline(point);
+    return false;
 }
 
 void FreehandShape::move(const QPoint& offset){
     for(QPoint& p : m_points){
         p += offset;
     }
-    updateBoundingRect();
+    m_boundingRect.translate(offset);
+    for(QRect& r : m_chunkBounds){
+        r.translate(offset);
+    }
+    for(QRect& r : m_groupBounds){
+        r.translate(offset);
+    }
+    for(Level& level : m_levels){
+        for(QPoint& p : level.points)
+            p += offset;
+    }
+    m_window.clear();
     emit shapeChanged();
 }
 
@@ -123,7 +157,7 @@ void FreehandShape::scale(double factor)
 }
 
 QRect FreehandShape::boundingRect() const{
-    return axisAlignedBoundingRect();
+    return m_boundingRect;
 }
 
 QJsonObject FreehandShape::toJson() const{
@@ -157,20 +191,54 @@ void FreehandShape::fromJson(const QJsonObject& json){
     }
 }
 
+void FreehandShape::writeBinary(BinaryWriter& out) const{
+    Shape::writeBinary(out);
+    out.writePoints(m_points);
+}
+
+void FreehandShape::readBinary(BinaryReader& in){
+    Shape::readBinary(in);
+    m_points = in.readPoints();
+    updateBoundingRect();
+}
+
+Shape::Type FreehandShape::type() const{
+    return Type::Freehand;
+}
+
 QString FreehandShape::name() const{
     return "Freehand";
 }
 
 QPoint FreehandShape::position() const{
-    return axisAlignedBoundingRect().topLeft();
+    return m_boundingRect.topLeft();
+}
+
+// Shares the points; the level and chunk caches are rebuilt if the copy is drawn
+Shape* FreehandShape::clone() const{
+    FreehandShape* copy = new FreehandShape();
+    copyStyleTo(copy);
+    copy->m_points = m_points;
+    copy->m_boundingRect = m_boundingRect;
+    copy->m_tolerance = m_tolerance;
+    return copy;
 }
 
 void FreehandShape::addPoint(const QPoint& point){
-    m_points.append(point);
-    updateBoundingRect();
+    appendPoint(point);
     emit shapeChanged();
 }
 
+void FreehandShape::finishStroke(){
+    if(m_window.isEmpty())
+        return;
+
+    QRect grown = m_boundingRect;
+    updateBoundingRect();
+    if(m_boundingRect != grown)
+        emit shapeChanged();
+}
+
 void FreehandShape::clearPoints(){
     m_points.clear();
     updateBoundingRect();
@@ -191,75 +259,190 @@ void FreehandShape::simplify(double tolerance){
     if(m_points.size() < 3)
         return;
 
-    QVector<QPoint> simplified;
-    simplified.append(m_points[0]);
+    QVector<QPoint> simplified = douglasPeucker(m_points, tolerance);
+    if(simplified.size() == m_points.size())
+        return;
+
+    m_points = simplified;
+    updateBoundingRect();
+    emit shapeChanged();
+}
 
-    for(size_t i = 1; i < m_points.size() - 1; ++i){
-        QPoint prev = m_points[i - 1];
-        QPoint current = m_points[i];
-        QPoint next = m_points[i + 1];
+double FreehandShape::tolerance() const{
+    return m_tolerance;
+}
 
-        double a = QLineF(prev, next).length();
-        double b = QLineF(prev, current).length();
-        double c = QLineF(current, next).length();
+void FreehandShape::setTolerance(double tolerance){
+    m_tolerance = qMax(0.0, tolerance);
+    m_window.clear();
+}
 
-        double p = (a + b + c) / 2;
-        double S = qSqrt(p * (p - a) * (p - b) * (p - c));
+void FreehandShape::appendPoint(const QPoint& point){
+    // Moves the stored end point to the new sample while the segment from the
+    // anchor still covers the window. Bounds only grow, so they stay valid but
+    // can be loose until finishStroke().
+    if(m_tolerance > 0 && m_points.size() >= 2 && !m_window.isEmpty()
+        && m_window.size() < MaxWindow && windowFits(m_points[m_points.size() - 2], point)){
+        m_window.append(point);
+        m_points.last() = point;
+        m_levelsValid = false;
+        m_boundingRect = extendRect(m_boundingRect, point);
+        if(m_chunksValid)
+            extendChunks(m_points.size() - 1);
+        return;
+    }
+
+    // The current end point is kept and becomes the anchor of the next segment
+    m_window.clear();
+    m_window.append(point);
+    m_points.append(point);
+    m_levelsValid = false;
+    m_boundingRect = m_points.size() == 1 ? QRect(point, point) : extendRect(m_boundingRect, point);
+    if(m_chunksValid)
+        extendChunks(m_points.size() - 1);
+}
 
-        double distance = (2 * S) / a;
+// Picks the coarsest level whose error stays under half a device pixel
+const QVector<QPoint>& FreehandShape::levelFor(const QTransform& transform) const{
+    // A stroke still being drawn changes with every sample; its levels are
+    // built on the first draw after finishStroke() instead of once per repaint
+    if(!m_window.isEmpty())
+        return m_points;
+
+    const double scale = qMax(qHypot(transform.m11(), transform.m12()), qHypot(transform.m21(), transform.m22()));
+    if(scale <= 0)
+        return m_points;
+
+    // At 1:1 and above even the finest level is too coarse, so nothing gets built
+    const double maxError = 0.5 / scale;
+    if(maxError <= LevelTolerance)
+        return m_points;
+
+    if(!m_levelsValid)
+        buildLevels();
+
+    const QVector<QPoint>* points = &m_points;
+    for(const Level& level : m_levels){
+        if(level.error >= maxError)
+            break;
+        points = &level.points;
+    }
+    return *points;
+}
+
+void FreehandShape::buildLevels() const{
+    m_levels.clear();
+    m_levelsValid = true;
+
+    // Each level is simplified from the previous one, so errors add up
+    double tolerance = LevelTolerance;
+    double error = 0.0;
+    const QVector<QPoint>* previous = &m_points;
+    while(previous->size() > 2 && m_levels.size() < MaxLevels){
+        error += tolerance;
+        QVector<QPoint> points = douglasPeucker(*previous, tolerance);
+        tolerance *= 2;
+        if(points.size() == previous->size())
+            continue;
+        m_levels.append({error, points});
+        previous = &m_levels.last().points;
+    }
+}
 
-        if(distance > tolerance){
-            simplified.append(current);
+// Iterative Douglas-Peucker: splits every span at its farthest point until
+// all points lie within tolerance of the chord
+QVector<QPoint> FreehandShape::douglasPeucker(const QVector<QPoint>& points, double tolerance){
+    if(points.size() < 3)
+        return points;
+
+    const double limit = tolerance * tolerance;
+    QVector<bool> keep(points.size(), false);
+    keep.first() = true;
+    keep.last() = true;
+
+    QVector<QPair<int, int>> spans;
+    spans.append(qMakePair(0, int(points.size()) - 1));
+    while(!spans.isEmpty()){
+        const QPair<int, int> span = spans.takeLast();
+        int farthest = -1;
+        double farthestDistance = limit;
+        for(int i = span.first + 1; i < span.second; ++i){
+            double distance = squaredSegmentDistance(points[i], points[span.first], points[span.second]);
+            if(distance > farthestDistance){
+                farthest = i;
+                farthestDistance = distance;
+            }
         }
+        if(farthest < 0)
+            continue;
+        keep[farthest] = true;
+        spans.append(qMakePair(span.first, farthest));
+        spans.append(qMakePair(farthest, span.second));
     }
 
-    simplified.append(m_points[m_points.size() - 1]);
-    m_points = simplified;
-    updateBoundingRect();
-    emit shapeChanged();
+    QVector<QPoint> simplified;
+    for(int i = 0; i < points.size(); ++i){
+        if(keep[i])
+            simplified.append(points[i]);
+    }
+    return simplified;
+}
+
+bool FreehandShape::windowFits(const QPoint& anchor, const QPoint& end) const{
+    const double limit = m_tolerance * m_tolerance;
+    for(const QPoint& sample : m_window){
+        if(squaredSegmentDistance(sample, anchor, end) > limit)
+            return false;
+    }
+    return true;
+}
+
+double FreehandShape::squaredSegmentDistance(const QPoint& point, const QPoint& p1, const QPoint& p2){
+    const double dx = p2.x() - p1.x();
+    const double dy = p2.y() - p1.y();
+    double px = point.x() - p1.x();
+    double py = point.y() - p1.y();
+    const double length = dx * dx + dy * dy;
+    if(length > 0){
+        double t = qBound(0.0, (px * dx + py * dy) / length, 1.0);
+        px -= t * dx;
+        py -= t * dy;
+    }
+    return px * px + py * py;
 }
 
 void FreehandShape::updateBoundingRect() {
     m_boundingRect = axisAlignedBoundingRect();
+    m_chunksValid = false;
+    m_levelsValid = false;
+    m_window.clear();
 }
 
-bool FreehandShape::isPointNearPolyline(const QPoint &point) const
+bool FreehandShape::isPointNearSegment(const QPoint& point, const QPoint& p1, const QPoint& p2) const
 {
-    if (m_points.size() < 2)
+    QLineF line(p1, p2);
+    double lineLength = line.length();
+    if (qFuzzyIsNull(lineLength))
         return false;
-    
-    for (int i = 1; i < m_points.size(); ++i) {
-        const QPoint &p1 = m_points[i-1];
-        const QPoint &p2 = m_points[i];
-        
-        QLineF line(p1, p2);
-        double lineLength = line.length();
-        if (qFuzzyIsNull(lineLength))
-            continue;
-        
-        QPointF lineVector = p2 - p1;
-        QPointF pointVector = point - p1;
-        
-        double t = (pointVector.x() * lineVector.x() + pointVector.y() * lineVector.y()) / 
-                  (lineLength * lineLength);
-        
-        t = qBound(0.0, t, 1.0);
-        
-        QPointF projected = p1 + t * lineVector;
-        
-        double distance = QLineF(projected, point).length();
-        
-        bool isOnSegment = (projected.x() >= qMin(p1.x(), p2.x()) - m_penWidth &&
-                          projected.x() <= qMax(p1.x(), p2.x()) + m_penWidth &&
-                          projected.y() >= qMin(p1.y(), p2.y()) - m_penWidth &&
-                          projected.y() <= qMax(p1.y(), p2.y()) + m_penWidth);
-        
-        if (isOnSegment && distance <= m_penWidth / 2 + 2) {
-            return true;
-        }
-    }
-    
-    return false;
+
+    QPointF lineVector = p2 - p1;
+    QPointF pointVector = point - p1;
+
+    double t = (pointVector.x() * lineVector.x() + pointVector.y() * lineVector.y()) / 
+              (lineLength * lineLength);
+
+    t = qBound(0.0, t, 1.0);
+
+    QPointF projected = p1 + t * lineVector;
+
+    double distance = QLineF(projected, point).length();
+
+    bool isOnSegment = (projected.x() >= qMin(p1.x(), p2.x()) - m_penWidth &&
+                      projected.x() <= qMax(p1.x(), p2.x()) + m_penWidth &&
+                      projected.y() >= qMin(p1.y(), p2.y()) - m_penWidth &&
+                      projected.y() <= qMax(p1.y(), p2.y()) + m_penWidth);
+
+    return isOnSegment && distance <= m_penWidth / 2 + 2;
 }
 
 void FreehandShape::applyTransform(const QTransform& transform){
@@ -267,4 +450,37 @@ void FreehandShape::applyTransform(const QTransform& transform){
         p = transform.map(p);
     }
     updateBoundingRect();
+}
+
+void FreehandShape::buildChunks() const{
+    m_chunkBounds.clear();
+    m_groupBounds.clear();
+    m_chunksValid = true;
+    for(int i = 0; i < m_points.size(); ++i){
+        extendChunks(i);
+    }
+}
+
+void FreehandShape::extendChunks(int index) const{
+    const QPoint& point = m_points[index];
+
+    // Chunk c owns segments ending at points c*ChunkSize+1 .. (c+1)*ChunkSize,
+    // so neighbouring chunks share their boundary point
+    const int chunk = index == 0 ? 0 : (index - 1) / ChunkSize;
+    if(chunk == m_chunkBounds.size()){
+        const QPoint& start = m_points[qMax(0, index - 1)];
+        m_chunkBounds.append(QRect(start, start));
+    }
+    m_chunkBounds[chunk] = extendRect(m_chunkBounds[chunk], point);
+
+    const int group = chunk / ChunkSize;
+    if(group == m_groupBounds.size()){
+        m_groupBounds.append(m_chunkBounds[chunk]);
+    }
+    m_groupBounds[group] = m_groupBounds[group].united(m_chunkBounds[chunk]);
+}
+
+QRect FreehandShape::extendRect(const QRect& rect, const QPoint& point){
+    return QRect(QPoint(qMin(rect.left(), point.x()), qMin(rect.top(), point.y())),
+                 QPoint(qMax(rect.right(), point.x()), qMax(rect.bottom(), point.y())));
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "../../include/shapes/LineShape.h"
+#include "../../include/BinaryStream.h"
 #include <QPainter>
 #include <QPen>
 #include <QtMath>
@@ -6,38 +7,28 @@
 
 LineShape::LineShape(const QPoint& startPoint, const QPoint& endPoint, QObject* parent)
     : Shape(parent), m_startPoint(startPoint), m_endPoint(endPoint) {
-    m_rotationAngle = qAtan2(m_endPoint.y() - m_startPoint.y(), m_endPoint.x() - m_startPoint.x());
+    updateAngle();
 }
 
-void LineShape::draw(QPainter* painter){
-    painter->save();
-
-    QPen pen(m_penColor, m_penWidth, m_penStyle);
-    pen.setCapStyle(Qt::RoundCap);
-    pen.setJoinStyle(Qt::RoundJoin);
-    painter->setPen(pen);
-    painter->setBrush(m_fillColor); 
-
+void LineShape::drawGeometry(QPainter* painter) const{
     painter->drawLine(m_startPoint, m_endPoint);
+}
 
-    if (m_selected) {
-        painter->setPen(QPen(Qt::blue, 2, Qt::DashLine));
-        painter->setBrush(Qt::NoBrush);
-        painter->drawRect(boundingRect().adjusted(-m_penWidth, -m_penWidth, m_penWidth, m_penWidth));
-        
-        painter->setPen(QPen(Qt::red, 2));
-        painter->setBrush(Qt::white);
-        painter->drawEllipse(m_startPoint, 4, 4);
-        painter->drawEllipse(m_endPoint, 4, 4);
-    }
+void LineShape::drawSelection(QPainter* painter) const{
+    painter->setPen(QPen(Qt::blue, 2, Qt::DashLine));
+    painter->setBrush(Qt::NoBrush);
+    painter->drawRect(boundingRect().adjusted(-m_penWidth, -m_penWidth, m_penWidth, m_penWidth));
 
-    painter->restore();
+    painter->setPen(QPen(Qt::red, 2));
+    painter->setBrush(Qt::white);
+    painter->drawEllipse(m_startPoint, 4, 4);
+    painter->drawEllipse(m_endPoint, 4, 4);
 }
 
 void LineShape::update(const QPoint& toPoint){
     if(m_endPoint != toPoint){
         m_endPoint = toPoint;
-        m_rotationAngle = qAtan2(m_endPoint.y() - m_startPoint.y(), m_endPoint.x() - m_startPoint.x());
+        updateAngle();
         emit shapeChanged();
     }
 }
@@ -63,12 +54,12 @@ void LineShape::move(const QPoint& offset){
 
 void LineShape::rotate(double angle){
     QPoint center = boundingRect().center();
-    QPointF newStart = rotatePoint(m_startPoint, center, angle);
-    QPointF newEnd = rotatePoint(m_endPoint, center, angle);
+    QPointF newStart = rotatePoint(m_startPoint, center, qDegreesToRadians(angle));
+    QPointF newEnd = rotatePoint(m_endPoint, center, qDegreesToRadians(angle));
     
     m_startPoint = newStart.toPoint();
     m_endPoint = newEnd.toPoint();
-    m_rotationAngle = qAtan2(m_endPoint.y() - m_startPoint.y(), m_endPoint.x() - m_startPoint.x());
+    updateAngle();
     emit shapeChanged();
 }
 
@@ -104,6 +95,24 @@ void LineShape::fromJson(const QJsonObject& json){
         m_endPoint.setX(json["endX"].toInt());
     if(json.contains("endY"))
         m_endPoint.setY(json["endY"].toInt());
+    updateAngle();
+}
+
+void LineShape::writeBinary(BinaryWriter& out) const{
+    Shape::writeBinary(out);
+    out.writePoint(m_startPoint);
+    out.writePoint(m_endPoint);
+}
+
+void LineShape::readBinary(BinaryReader& in){
+    Shape::readBinary(in);
+    m_startPoint = in.readPoint();
+    m_endPoint = in.readPoint();
+    updateAngle();
+}
+
+Shape::Type LineShape::type() const{
+    return Type::Line;
 }
 
 QString LineShape::name() const{
@@ -114,6 +123,12 @@ QPoint LineShape::position() const{
     return m_startPoint;
 }
 
+Shape* LineShape::clone() const{
+    LineShape* copy = new LineShape(m_startPoint, m_endPoint);
+    copyStyleTo(copy);
+    return copy;
+}
+
 QPoint LineShape::startPoint() const{
     return m_startPoint;
 }
@@ -125,7 +140,7 @@ QPoint LineShape::endPoint() const{
 void LineShape::setStartPoint(const QPoint& point){
     if (m_startPoint != point) {
         m_startPoint = point;
-        m_rotationAngle = qAtan2(m_endPoint.y() - m_startPoint.y(), m_endPoint.x() - m_startPoint.x());
+        updateAngle();
         emit shapeChanged();
     }
 }
@@ -133,7 +148,7 @@ void LineShape::setStartPoint(const QPoint& point){
 void LineShape::setEndPoint(const QPoint& point){
     if (m_endPoint != point) {
         m_endPoint = point;        
-        m_rotationAngle = qAtan2(m_endPoint.y() - m_startPoint.y(), m_endPoint.x() - m_startPoint.x());
+        updateAngle();
         emit shapeChanged();
     }
 }
@@ -147,6 +162,12 @@ double LineShape::angle() const{
     return m_rotationAngle;
 }
 
+// Degrees like every other shape; files from before stored radians, so the
+// angle always comes from the end points
+void LineShape::updateAngle(){
+    m_rotationAngle = qRadiansToDegrees(qAtan2(m_endPoint.y() - m_startPoint.y(), m_endPoint.x() - m_startPoint.x()));
+}
+
 double LineShape::distanceToLine(const QPoint &point) const{
     if (m_startPoint == m_endPoint) {
         return qSqrt(qPow(point.x() - m_startPoint.x(), 2) + 
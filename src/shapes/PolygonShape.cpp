@@ -1,4 +1,5 @@
 #include "../../include/shapes/PolygonShape.h"
+#include "../../include/BinaryStream.h"
 
 PolygonShape::PolygonShape(QObject* parent) : Shape(parent) {}
 
@@ -7,36 +8,35 @@ PolygonShape::PolygonShape(const QPolygon& polygon, QObject* parent) :
     updateBoundingRect();
 }
 
-void PolygonShape::draw(QPainter* painter){
+void PolygonShape::drawGeometry(QPainter* painter) const{
     if (m_polygon.size() < 2)
         return;
 
-    painter->save();
-
-    QPen pen(m_penColor, m_penWidth, m_penStyle);
-    painter->setPen(pen);
-    painter->setBrush(m_fillColor);
-
     if (m_closed) {
         painter->drawPolygon(m_polygon);
     } else {
         painter->drawPolyline(m_polygon);
     }
+}
 
-    if (m_selected) {
-        QRect selectionRect = axisAlignedBoundingRect().adjusted(-3, -3, 3, 3);
-        painter->setPen(QPen(Qt::blue, 2, Qt::DashLine));
-        painter->setBrush(Qt::NoBrush);
-        painter->drawRect(selectionRect);
+void PolygonShape::drawSelection(QPainter* painter) const{
+    if (m_polygon.size() < 2)
+        return;
 
-        painter->setPen(QPen(Qt::red, 2));
-        painter->setBrush(Qt::white);
-        for (const QPoint &p : m_polygon) {
-            painter->drawEllipse(p, 4, 4);
-        }
+    QRect selectionRect = axisAlignedBoundingRect().adjusted(-3, -3, 3, 3);
+    painter->setPen(QPen(Qt::blue, 2, Qt::DashLine));
+    painter->setBrush(Qt::NoBrush);
+    painter->drawRect(selectionRect);
+
+    painter->setPen(QPen(Qt::red, 2));
+    painter->setBrush(Qt::white);
+    for (const QPoint &p : m_polygon) {
+        painter->drawEllipse(p, 4, 4);
     }
+}
 
-    painter->restore();
+bool PolygonShape::hasRoundPen() const{
+    return false;
 }
 
 void PolygonShape::update(const QPoint& toPoint){
@@ -133,6 +133,23 @@ void PolygonShape::fromJson(const QJsonObject &json) {
     updateBoundingRect();
 }
 
+void PolygonShape::writeBinary(BinaryWriter& out) const{
+    Shape::writeBinary(out);
+    out.writeByte(m_closed ? 1 : 0);
+    out.writePoints(m_polygon);
+}
+
+void PolygonShape::readBinary(BinaryReader& in){
+    Shape::readBinary(in);
+    m_closed = in.readByte() != 0;
+    m_polygon = QPolygon(in.readPoints());
+    updateBoundingRect();
+}
+
+Shape::Type PolygonShape::type() const{
+    return Type::Polygon;
+}
+
 QString PolygonShape::name() const{
     return "Polygon";
 }
@@ -141,6 +158,15 @@ QPoint PolygonShape::position() const {
     return m_boundingRect.topLeft();
 }
 
+Shape* PolygonShape::clone() const{
+    PolygonShape* copy = new PolygonShape();
+    copyStyleTo(copy);
+    copy->m_polygon = m_polygon;
+    copy->m_closed = m_closed;
+    copy->m_boundingRect = m_boundingRect;
+    return copy;
+}
+
 void PolygonShape::addPoint(const QPoint &point) {
     m_polygon << point;
     updateBoundingRect();
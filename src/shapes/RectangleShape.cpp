@@ -1,4 +1,5 @@
 #include "../../include/shapes/RectangleShape.h"
+#include "../../include/BinaryStream.h"
 
 RectangleShape::RectangleShape(const QRect& rect, QObject* parent) :
     Shape(parent), m_rect(rect) {}
@@ -6,45 +7,35 @@ RectangleShape::RectangleShape(const QRect& rect, QObject* parent) :
 RectangleShape::RectangleShape(const QPoint& topLeft, const QPoint& bottomRight, QObject* parent) :
     Shape(parent), m_rect(QRect(topLeft, bottomRight).normalized()) {}
 
-void RectangleShape::draw(QPainter* painter){
-    qDebug() << "Paint rect";   
-    painter->save();
-
-    QPen pen(m_penColor, m_penWidth, m_penStyle);
-    pen.setCapStyle(Qt::RoundCap);
-    pen.setJoinStyle(Qt::RoundJoin);
-    painter->setPen(pen);
-    painter->setBrush(m_fillColor);
-
+void RectangleShape::drawGeometry(QPainter* painter) const{
     if (qFuzzyIsNull(m_rotationAngle)) {
         painter->drawRect(m_rect);
     } else {
-        painter->translate(rotationCenter());
-        painter->rotate(m_rotationAngle);
-        painter->translate(-rotationCenter());
+        // Rotate on top of the caller's transform, not instead of it; only
+        // the transform is put back, a full save() would copy the whole state
+        const QTransform transform = painter->worldTransform();
+        painter->setWorldTransform(rotationTransform(), true);
         painter->drawRect(m_rect);
-        painter->resetTransform();
+        painter->setWorldTransform(transform);
     }
+}
 
-    if (m_selected) {
-        QRect selectionRect = axisAlignedBoundingRect().adjusted(-m_penWidth, -m_penWidth, m_penWidth, m_penWidth);
-        
-        painter->setPen(QPen(Qt::blue, 2, Qt::DashLine));
-        painter->setBrush(Qt::NoBrush);
-        painter->drawRect(selectionRect);
+void RectangleShape::drawSelection(QPainter* painter) const{
+    QRect selectionRect = axisAlignedBoundingRect().adjusted(-m_penWidth, -m_penWidth, m_penWidth, m_penWidth);
 
-        painter->setPen(QPen(Qt::red, 2));
-        painter->setBrush(Qt::white);
-        
-        QPolygonF poly = rotatedPolygon();
-        for (const QPointF &point : poly) {
-            painter->drawEllipse(point, 4, 4);
-        }
-        
-        painter->drawEllipse(rotationCenter(), 6, 6);
+    painter->setPen(QPen(Qt::blue, 2, Qt::DashLine));
+    painter->setBrush(Qt::NoBrush);
+    painter->drawRect(selectionRect);
+
+    painter->setPen(QPen(Qt::red, 2));
+    painter->setBrush(Qt::white);
+
+    QPolygonF poly = rotatedPolygon();
+    for (const QPointF &point : poly) {
+        painter->drawEllipse(point, 4, 4);
     }
 
-    painter->restore();
+    painter->drawEllipse(rotationCenter(), 6, 6);
 }
 
 void RectangleShape::update(const QPoint& toPoint){
@@ -82,7 +73,7 @@ void RectangleShape::move(const QPoint &offset){
 }
 
 void RectangleShape::rotate(double angle){
-    m_rotationAngle = angle;
+    m_rotationAngle += angle;
     while(m_rotationAngle >= 360.0)
         m_rotationAngle -= 360.0;
     while(m_rotationAngle < 0.0)
@@ -119,6 +110,7 @@ QJsonObject RectangleShape::toJson() const{
     json["y"] = m_rect.y();
     json["width"] = m_rect.width();
     json["height"] = m_rect.height();
+    return json;
 }
 
 void RectangleShape::fromJson(const QJsonObject& json){
@@ -130,7 +122,21 @@ void RectangleShape::fromJson(const QJsonObject& json){
     if(json.contains("width"))
         m_rect.setWidth(json["width"].toInt());
     if(json.contains("height"))
-        m_rect.setWidth(json["height"].toInt());
+        m_rect.setHeight(json["height"].toInt());
+}
+
+void RectangleShape::writeBinary(BinaryWriter& out) const{
+    Shape::writeBinary(out);
+    out.writeRect(m_rect);
+}
+
+void RectangleShape::readBinary(BinaryReader& in){
+    Shape::readBinary(in);
+    m_rect = in.readRect();
+}
+
+Shape::Type RectangleShape::type() const{
+    return Type::Rectangle;
 }
 
 QString RectangleShape::name() const{ 
@@ -141,6 +147,12 @@ QPoint RectangleShape::position() const{
     return m_rect.topLeft(); 
 }
 
+Shape* RectangleShape::clone() const{
+    RectangleShape* copy = new RectangleShape(m_rect);
+    copyStyleTo(copy);
+    return copy;
+}
+
 QRect RectangleShape::rect() const{
     return m_rect;
 }
@@ -174,19 +186,46 @@ void RectangleShape::setHeight(int height){
     }
 }
 
-QPolygonF RectangleShape::rotatedPolygon() const{
-    if (qFuzzyIsNull(m_rotationAngle)) {
-        return QPolygonF(QRectF(m_rect));
+void RectangleShape::prepareDraw(const QTransform& deviceTransform) const{
+    Q_UNUSED(deviceTransform);
+    if (!qFuzzyIsNull(m_rotationAngle)) {
+        updatePolygonCache();
     }
-    QPolygonF polygon;
-    polygon << m_rect.topLeft() << m_rect.topRight() << m_rect.bottomLeft() << m_rect.bottomRight();
+}
+
+void RectangleShape::updatePolygonCache() const{
+    if (m_polygonCacheValid && m_polygonCacheRect == m_rect && m_polygonCacheAngle == m_rotationAngle) {
+        return;
+    }
+
     QPointF center = rotationCenter();
     QTransform transform;
     transform.translate(center.x(), center.y());
     transform.rotate(m_rotationAngle);
     transform.translate(-center.x(), -center.y());
 
-    return transform.map(polygon);
+    // Corners in outline order, so containsPoint() sees a simple polygon
+    QPolygonF polygon;
+    polygon << m_rect.topLeft() << m_rect.topRight() << m_rect.bottomRight() << m_rect.bottomLeft();
+
+    m_transformCache = transform;
+    m_polygonCache = transform.map(polygon);
+    m_polygonCacheRect = m_rect;
+    m_polygonCacheAngle = m_rotationAngle;
+    m_polygonCacheValid = true;
+}
+
+QPolygonF RectangleShape::rotatedPolygon() const{
+    if (qFuzzyIsNull(m_rotationAngle)) {
+        return QPolygonF(QRectF(m_rect));
+    }
+    updatePolygonCache();
+    return m_polygonCache;
+}
+
+const QTransform& RectangleShape::rotationTransform() const{
+    updatePolygonCache();
+    return m_transformCache;
 }
 
 QPointF RectangleShape::rotationCenter() const{
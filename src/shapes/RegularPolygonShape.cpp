@@ -1,4 +1,5 @@
 #include "../../include/shapes/RegularPolygonShape.h"
+#include "../../include/BinaryStream.h"
 
 RegularPolygonShape::RegularPolygonShape(QObject* parent) : 
     Shape(parent), m_center(0, 0), m_radius(0), m_sides(3) {}
@@ -6,33 +7,35 @@ RegularPolygonShape::RegularPolygonShape(QObject* parent) :
 RegularPolygonShape::RegularPolygonShape(const QPoint& center, int radius, int sides, QObject* parent) : 
     Shape(parent), m_center(center), m_radius(radius), m_sides(sides) {}
 
-void RegularPolygonShape::draw(QPainter* painter) {
+void RegularPolygonShape::drawGeometry(QPainter* painter) const{
     if (m_sides < 3 || m_radius <= 0) return;
 
-    painter->save();
+    painter->drawPolygon(polygon());
+}
 
-    QPen pen(m_penColor, m_penWidth, m_penStyle);
-    painter->setPen(pen);
-    painter->setBrush(m_fillColor);
+void RegularPolygonShape::drawSelection(QPainter* painter) const{
+    if (m_sides < 3 || m_radius <= 0) return;
 
-    QPolygon polygon = createPolygon();
-    painter->drawPolygon(polygon);
+    QRect selectionRect = boundingRect().adjusted(-3, -3, 3, 3);
+    painter->setPen(QPen(Qt::blue, 2, Qt::DashLine));
+    painter->setBrush(Qt::NoBrush);
+    painter->drawRect(selectionRect);
 
-    if (m_selected) {
-        QRect selectionRect = boundingRect().adjusted(-3, -3, 3, 3);
-        painter->setPen(QPen(Qt::blue, 2, Qt::DashLine));
-        painter->setBrush(Qt::NoBrush);
-        painter->drawRect(selectionRect);
-
-        painter->setPen(QPen(Qt::red, 2));
-        painter->setBrush(Qt::white);
-        for (const QPoint &p : polygon) {
-            painter->drawEllipse(p, 4, 4);
-        }
-        painter->drawEllipse(m_center, 6, 6);
+    painter->setPen(QPen(Qt::red, 2));
+    painter->setBrush(Qt::white);
+    for (const QPoint &p : polygon()) {
+        painter->drawEllipse(p, 4, 4);
     }
+    painter->drawEllipse(m_center, 6, 6);
+}
 
-    painter->restore();
+void RegularPolygonShape::prepareDraw(const QTransform& deviceTransform) const{
+    Q_UNUSED(deviceTransform);
+    polygon();
+}
+
+bool RegularPolygonShape::hasRoundPen() const{
+    return false;
 }
 
 void RegularPolygonShape::update(const QPoint& toPoint) {
@@ -44,8 +47,7 @@ bool RegularPolygonShape::contains(const QPoint& point) const {
     if (m_sides < 3 || m_radius <= 0) return false;
     
     if (m_selected) {
-        QPolygon polygon = createPolygon();
-        for (const QPoint &p : polygon) {
+        for (const QPoint &p : polygon()) {
             if (QRect(p.x()-5, p.y()-5, 10, 10).contains(point)) {
                 return true;
             }
@@ -55,7 +57,7 @@ bool RegularPolygonShape::contains(const QPoint& point) const {
         }
     }
     
-    return createPolygon().containsPoint(point, Qt::OddEvenFill);
+    return polygon().containsPoint(point, Qt::OddEvenFill);
 }
 
 void RegularPolygonShape::move(const QPoint& offset){
@@ -64,7 +66,7 @@ void RegularPolygonShape::move(const QPoint& offset){
 }
 
 void RegularPolygonShape::rotate(double angle){
-    m_rotationAngle = angle;
+    m_rotationAngle += angle;
     emit shapeChanged();
 }
 
@@ -102,6 +104,24 @@ void RegularPolygonShape::fromJson(const QJsonObject &json) {
         m_rotationAngle = json["rotation"].toDouble();
 }
 
+void RegularPolygonShape::writeBinary(BinaryWriter& out) const{
+    Shape::writeBinary(out);
+    out.writePoint(m_center);
+    out.writeVarint(quint64(qMax(0, m_radius)));
+    out.writeVarint(quint64(qMax(0, m_sides)));
+}
+
+void RegularPolygonShape::readBinary(BinaryReader& in){
+    Shape::readBinary(in);
+    m_center = in.readPoint();
+    m_radius = int(in.readVarint());
+    m_sides = int(in.readVarint());
+}
+
+Shape::Type RegularPolygonShape::type() const{
+    return Type::RegularPolygon;
+}
+
 QString RegularPolygonShape::name() const{
     return "Regular polygon";
 }
@@ -110,6 +130,12 @@ QPoint RegularPolygonShape::position() const{
     return m_center - QPoint(m_radius, m_radius);
 }
 
+Shape* RegularPolygonShape::clone() const{
+    RegularPolygonShape* copy = new RegularPolygonShape(m_center, m_radius, m_sides);
+    copyStyleTo(copy);
+    return copy;
+}
+
 QPoint RegularPolygonShape::center() const{
     return m_center;
 }
@@ -146,16 +172,28 @@ void RegularPolygonShape::setRotation(double angle) {
     emit shapeChanged();
 }
 
-QPolygon RegularPolygonShape::createPolygon() const{
-    QPolygon polygon;
+const QPolygon& RegularPolygonShape::polygon() const{
+    if (m_polygonCacheValid && m_polygonCacheCenter == m_center && m_polygonCacheRadius == m_radius
+        && m_polygonCacheSides == m_sides && m_polygonCacheAngle == m_rotationAngle) {
+        return m_polygonCache;
+    }
+
+    QPolygon vertices;
+    vertices.reserve(qMax(m_sides, 0));
     double angleStep = 2 * M_PI / m_sides;
-    
+
     for (int i = 0; i < m_sides; ++i) {
         double angle = m_rotationAngle * M_PI / 180 + i * angleStep;
         int x = m_center.x() + m_radius * cos(angle);
         int y = m_center.y() + m_radius * sin(angle);
-        polygon << QPoint(x, y);
+        vertices << QPoint(x, y);
     }
-    
-    return polygon;
+
+    m_polygonCache = vertices;
+    m_polygonCacheCenter = m_center;
+    m_polygonCacheRadius = m_radius;
+    m_polygonCacheSides = m_sides;
+    m_polygonCacheAngle = m_rotationAngle;
+    m_polygonCacheValid = true;
+    return m_polygonCache;
 }
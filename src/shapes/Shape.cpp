@@ -1,4 +1,5 @@
 #include "../../include/shapes/Shape.h"
+#include "../../include/BinaryStream.h"
 
 Shape::Shape(QObject *parent) 
     : QObject(parent),
@@ -10,6 +11,20 @@ Shape::Shape(QObject *parent)
       m_animating(false),
       m_rotationAngle(0.0) {}
 
+void Shape::draw(QPainter* painter) const{
+    painter->save();
+    painter->setPen(pen());
+    painter->setBrush(brush());
+    drawGeometry(painter);
+    if(m_selected)
+        drawSelection(painter);
+    painter->restore();
+}
+
+void Shape::prepareDraw(const QTransform& deviceTransform) const{
+    Q_UNUSED(deviceTransform);
+}
+
 void Shape::move(const QPoint& offset){
     Q_UNUSED(offset);
     emit shapeChanged();
@@ -25,6 +40,15 @@ void Shape::scale(double factor){
     emit shapeChanged();
 }
 
+QRect Shape::repaintRect() const{
+    QRect bounds = boundingRect();
+    if(bounds.isNull())
+        return QRect();
+    // Selection frame is drawn pen width outside the bounds, handles stick out a few pixels more
+    int margin = m_penWidth + 8;
+    return bounds.adjusted(-margin, -margin, margin, margin);
+}
+
 void Shape::setPenColor(const QColor& color){
     if(m_penColor != color){
         m_penColor = color;
@@ -75,6 +99,38 @@ QColor Shape::fillColor() const{
 Qt::PenStyle Shape::penStyle() const{
     return m_penStyle;
 }
+
+QPen Shape::pen() const{
+    QPen pen(m_penColor, m_penWidth, m_penStyle);
+    if(hasRoundPen()){
+        pen.setCapStyle(Qt::RoundCap);
+        pen.setJoinStyle(Qt::RoundJoin);
+    }
+    return pen;
+}
+
+QBrush Shape::brush() const{
+    return QBrush(m_fillColor);
+}
+
+bool Shape::hasSameStyle(const Shape* other) const{
+    return m_penColor == other->m_penColor && m_penWidth == other->m_penWidth
+        && m_penStyle == other->m_penStyle && m_fillColor == other->m_fillColor
+        && hasRoundPen() == other->hasRoundPen();
+}
+
+void Shape::copyStyleTo(Shape* copy) const{
+    copy->m_penColor = m_penColor;
+    copy->m_penWidth = m_penWidth;
+    copy->m_fillColor = m_fillColor;
+    copy->m_penStyle = m_penStyle;
+    copy->m_rotationAngle = m_rotationAngle;
+}
+
+bool Shape::hasRoundPen() const{
+    return true;
+}
+
 double Shape::rotationAngle() const{
     return m_rotationAngle;
 }
@@ -82,9 +138,9 @@ double Shape::rotationAngle() const{
 QJsonObject Shape::toJson() const
 {
     QJsonObject json;
-    json["penColor"] = m_penColor.name();
+    json["penColor"] = m_penColor.name(QColor::HexArgb);
     json["penWidth"] = m_penWidth;
-    json["fillColor"] = m_fillColor.name();
+    json["fillColor"] = m_fillColor.name(QColor::HexArgb);
     json["penStyle"] = static_cast<int>(m_penStyle);
     json["rotationAngle"] = m_rotationAngle;
     return json;
@@ -107,6 +163,22 @@ void Shape::fromJson(const QJsonObject &json)
         m_rotationAngle = json["rotationAngle"].toDouble();
 }
 
+void Shape::writeBinary(BinaryWriter& out) const{
+    out.writeColor(m_penColor);
+    out.writeColor(m_fillColor);
+    out.writeVarint(quint64(qMax(0, m_penWidth)));
+    out.writeByte(quint8(m_penStyle));
+    out.writeDouble(m_rotationAngle);
+}
+
+void Shape::readBinary(BinaryReader& in){
+    m_penColor = in.readColor();
+    m_fillColor = in.readColor();
+    m_penWidth = int(in.readVarint());
+    m_penStyle = static_cast<Qt::PenStyle>(in.readByte());
+    m_rotationAngle = in.readDouble();
+}
+
 bool Shape::isSelected() const{
     return m_selected;
 }
@@ -0,0 +1,110 @@
+#include "../include/CanvasWidget.h"
+#include "../include/CanvasCommands.h"
+#include "../include/AnimationManager.h"
+#include "../include/shapes/RectangleShape.h"
+#include <QtTest>
+
+// Edits pushed while a shape animates must stay put: the next frame would
+// otherwise rebuild the shape from its animation base without them.
+class CanvasCommandsTest : public QObject{
+
+    Q_OBJECT
+
+    private slots:
+        void init();
+        void cleanup();
+
+        void moveStopsAnimation();
+        void propertyStopsAnimation();
+        void undoStopsAnimation();
+        void removeRestoresAnimationBase();
+
+    private:
+        // A few frames at the animation clock's 60 Hz
+        static const int FrameWaitMs = 100;
+
+        void animate(AnimationManager::Property property, const QVariant& to);
+
+        CanvasWidget* m_canvas = nullptr;
+        RectangleShape* m_shape = nullptr;
+};
+
+void CanvasCommandsTest::init(){
+    m_canvas = new CanvasWidget();
+    m_shape = new RectangleShape(QRect(100, 100, 80, 40));
+    m_canvas->undoStack()->push(new AddShapesCommand(m_canvas, {m_shape}, {1}, "Add"));
+}
+
+void CanvasCommandsTest::cleanup(){
+    delete m_canvas;
+    m_canvas = nullptr;
+    m_shape = nullptr;
+}
+
+void CanvasCommandsTest::animate(AnimationManager::Property property, const QVariant& to){
+    m_canvas->animations()->animate(m_shape, property, to, 1000, AnimationManager::Loop::Repeat,
+                                    QEasingCurve(QEasingCurve::Linear));
+    QTest::qWait(FrameWaitMs);
+    QVERIFY(m_shape->isAnimating());
+}
+
+void CanvasCommandsTest::moveStopsAnimation(){
+    animate(AnimationManager::Property::Offset, QPoint(200, 0));
+    QPoint shown = m_shape->position();
+
+    m_canvas->undoStack()->push(new MoveShapeCommand(m_canvas, m_shape, QPoint(5, 5)));
+    QVERIFY(!m_canvas->animations()->isAnimating(m_shape));
+    QVERIFY(!m_shape->isAnimating());
+    QCOMPARE(m_shape->position(), shown + QPoint(5, 5));
+
+    QTest::qWait(FrameWaitMs);
+    QCOMPARE(m_shape->position(), shown + QPoint(5, 5));
+
+    m_canvas->undoStack()->undo();
+    QCOMPARE(m_shape->position(), shown);
+}
+
+void CanvasCommandsTest::propertyStopsAnimation(){
+    animate(AnimationManager::Property::FillColor, QColor(Qt::red));
+    QColor shown = m_shape->fillColor();
+
+    m_canvas->undoStack()->push(new ShapePropertyCommand(m_canvas, m_shape, ShapePropertyCommand::Property::FillColor,
+                                                         QColor(Qt::blue)));
+    QVERIFY(!m_shape->isAnimating());
+    QTest::qWait(FrameWaitMs);
+    QCOMPARE(m_shape->fillColor(), QColor(Qt::blue));
+
+    m_canvas->undoStack()->undo();
+    QTest::qWait(FrameWaitMs);
+    QCOMPARE(m_shape->fillColor(), shown);
+}
+
+void CanvasCommandsTest::undoStopsAnimation(){
+    m_canvas->undoStack()->push(new MoveShapeCommand(m_canvas, m_shape, QPoint(10, 0)));
+    animate(AnimationManager::Property::Offset, QPoint(0, 200));
+    QPoint shown = m_shape->position();
+
+    m_canvas->undoStack()->undo();
+    QVERIFY(!m_shape->isAnimating());
+    QTest::qWait(FrameWaitMs);
+    QCOMPARE(m_shape->position(), shown - QPoint(10, 0));
+}
+
+void CanvasCommandsTest::removeRestoresAnimationBase(){
+    QRect base = m_shape->boundingRect();
+    animate(AnimationManager::Property::Rotation, 360.0);
+    QVERIFY(!qFuzzyIsNull(m_shape->rotationAngle()));
+
+    m_canvas->undoStack()->push(new RemoveShapesCommand(m_canvas, {m_shape}, "Delete"));
+    QVERIFY(!m_canvas->animations()->isAnimating(m_shape));
+    QVERIFY(!m_shape->isAnimating());
+    QCOMPARE(m_shape->rotationAngle(), 0.0);
+
+    m_canvas->undoStack()->undo();
+    QTest::qWait(FrameWaitMs);
+    QVERIFY(!m_shape->isAnimating());
+    QCOMPARE(m_shape->boundingRect(), base);
+}
+
+QTEST_MAIN(CanvasCommandsTest)
+#include "canvas_commands_test.moc"
@@ -0,0 +1,240 @@
+#include "../include/DocumentIO.h"
+#include "../include/BinaryStream.h"
+#include "../include/shapes/LineShape.h"
+#include "../include/shapes/FreehandShape.h"
+#include "../include/shapes/RectangleShape.h"
+#include "../include/shapes/EllipseShape.h"
+#include "../include/shapes/PolygonShape.h"
+#include "../include/shapes/RegularPolygonShape.h"
+#include <QBuffer>
+#include <QTemporaryDir>
+#include <QtTest>
+#include <limits>
+
+// The binary format has to give back exactly what was saved, and input that
+// is cut short or damaged has to be refused without reading past its end.
+class DocumentIOTest : public QObject{
+
+    Q_OBJECT
+
+    private slots:
+        void init();
+        void cleanup();
+
+        void varintRoundTrip();
+        void truncatedVarint();
+        void pointsRoundTrip();
+        void binaryRoundTrip();
+        void truncatedDocument();
+        void corruptHeader();
+        void corruptRecord();
+        void damagedBytes();
+
+    private:
+        // One shape of every type, none with the default style
+        void createShapes();
+        QByteArray encode(const QList<Shape*>& shapes);
+        static QJsonArray toJson(const QList<Shape*>& shapes);
+
+        QList<Shape*> m_shapes;
+};
+
+void DocumentIOTest::init(){
+    createShapes();
+}
+
+void DocumentIOTest::cleanup(){
+    qDeleteAll(m_shapes);
+    m_shapes.clear();
+}
+
+void DocumentIOTest::createShapes(){
+    m_shapes.append(new LineShape(QPoint(-40, 10), QPoint(300, -250)));
+    // Deltas of both signs and of several varint lengths
+    m_shapes.append(new FreehandShape({QPoint(0, 0), QPoint(1, 1), QPoint(-70000, 300),
+                                       QPoint(65000, -1), QPoint(65000, -1), QPoint(-3, 8)}));
+    m_shapes.append(new RectangleShape(QRect(-20, -30, 200, 100)));
+    m_shapes.append(new EllipseShape(QRect(50, 60, 70, 30)));
+    m_shapes.append(new PolygonShape(QPolygon({QPoint(0, 0), QPoint(100, 0), QPoint(50, -80)})));
+    m_shapes.append(new RegularPolygonShape(QPoint(400, 400), 60, 7));
+
+    for(int i = 0; i < m_shapes.size(); ++i){
+        Shape* shape = m_shapes[i];
+        shape->setPenColor(QColor(10 * i, 200, 30, 128 + i));
+        shape->setFillColor(QColor(255, 20 * i, 0, 64));
+        shape->setPenWidth(i + 2);
+        shape->setPenStyle(Qt::DashLine);
+        shape->setRotationAngle(12.5 * i);
+    }
+}
+
+QByteArray DocumentIOTest::encode(const QList<Shape*>& shapes){
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    if(!DocumentIO::writeBinary(shapes, &buffer))
+        return QByteArray();
+    return buffer.data();
+}
+
+QJsonArray DocumentIOTest::toJson(const QList<Shape*>& shapes){
+    QJsonArray json;
+    for(const Shape* shape : shapes)
+        json.append(shape->toJson());
+    return json;
+}
+
+void DocumentIOTest::varintRoundTrip(){
+    const QVector<quint64> unsignedValues = {0, 1, 0x7f, 0x80, 0x3fff, 0x4000, 0xffffffffu,
+                                             std::numeric_limits<quint64>::max()};
+    const QVector<qint64> signedValues = {0, -1, 1, -64, 64, -65, std::numeric_limits<qint64>::min(),
+                                          std::numeric_limits<qint64>::max()};
+    QByteArray data;
+    BinaryWriter out(&data);
+    for(quint64 value : unsignedValues)
+        out.writeVarint(value);
+    for(qint64 value : signedValues)
+        out.writeSVarint(value);
+
+    BinaryReader in(data.constData(), data.size());
+    for(quint64 value : unsignedValues)
+        QCOMPARE(in.readVarint(), value);
+    for(qint64 value : signedValues)
+        QCOMPARE(in.readSVarint(), value);
+    QVERIFY(!in.hasError());
+    QVERIFY(in.atEnd());
+
+    // Zig-zag keeps small magnitudes short whatever their sign
+    QByteArray small;
+    BinaryWriter(&small).writeSVarint(-64);
+    QCOMPARE(small.size(), 1);
+}
+
+void DocumentIOTest::truncatedVarint(){
+    const char cut[] = {char(0x80), char(0x80)};
+    BinaryReader shortInput(cut, sizeof(cut));
+    shortInput.readVarint();
+    QVERIFY(shortInput.hasError());
+
+    // Eleven continuation bytes are longer than any 64-bit value
+    const QByteArray overlong(11, char(0x80));
+    BinaryReader longInput(overlong.constData(), overlong.size());
+    longInput.readVarint();
+    QVERIFY(longInput.hasError());
+
+    // Reads after an error keep failing instead of resuming mid-stream
+    QCOMPARE(longInput.readByte(), quint8(0));
+    QVERIFY(longInput.hasError());
+}
+
+void DocumentIOTest::pointsRoundTrip(){
+    const QVector<QPoint> points = static_cast<FreehandShape*>(m_shapes[1])->points();
+    QByteArray data;
+    BinaryWriter(&data).writePoints(points);
+
+    BinaryReader in(data.constData(), data.size());
+    QCOMPARE(in.readPoints(), points);
+    QVERIFY(!in.hasError());
+
+    // A count the remaining bytes cannot hold is refused before allocating
+    QByteArray bogus;
+    BinaryWriter(&bogus).writeVarint(1u << 30);
+    bogus.append(8, '\0');
+    BinaryReader bogusIn(bogus.constData(), bogus.size());
+    QVERIFY(bogusIn.readPoints().isEmpty());
+    QVERIFY(bogusIn.hasError());
+}
+
+void DocumentIOTest::binaryRoundTrip(){
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.filePath(QString("shapes") + DocumentIO::BinarySuffix);
+    QCOMPARE(DocumentIO::formatForFile(fileName), DocumentIO::Format::Binary);
+    QVERIFY(DocumentIO::save(m_shapes, fileName));
+
+    QList<Shape*> loaded;
+    QVERIFY(DocumentIO::load(fileName, loaded));
+    QCOMPARE(loaded.size(), m_shapes.size());
+    for(int i = 0; i < loaded.size(); ++i){
+        QCOMPARE(loaded[i]->type(), m_shapes[i]->type());
+        QCOMPARE(loaded[i]->boundingRect(), m_shapes[i]->boundingRect());
+    }
+    QCOMPARE(toJson(loaded), toJson(m_shapes));
+
+    // Records encoded on their own decode to the same shapes
+    for(const Shape* shape : m_shapes){
+        Shape* decoded = DocumentIO::decodeRecord(DocumentIO::encodeRecord(shape));
+        QVERIFY(decoded);
+        QCOMPARE(decoded->toJson(), shape->toJson());
+        delete decoded;
+    }
+    qDeleteAll(loaded);
+}
+
+void DocumentIOTest::truncatedDocument(){
+    const QByteArray data = encode(m_shapes);
+    QVERIFY(!data.isEmpty());
+
+    // Every prefix lacks at least the end marker
+    for(int size = 0; size < data.size(); ++size){
+        QList<Shape*> shapes;
+        QVector<DocumentIO::BinaryRecord> records;
+        QVERIFY2(!DocumentIO::scanBinary(data.constData(), size, records), qPrintable(QString::number(size)));
+        QVERIFY2(!DocumentIO::readBinary(data.constData(), size, shapes), qPrintable(QString::number(size)));
+        QVERIFY(shapes.isEmpty());
+    }
+}
+
+void DocumentIOTest::corruptHeader(){
+    const QByteArray data = encode(m_shapes);
+    QList<Shape*> shapes;
+
+    QByteArray magic = data;
+    magic[0] = 'X';
+    QVERIFY(!DocumentIO::readBinary(magic.constData(), magic.size(), shapes));
+
+    // Written by a newer version than this reader knows
+    QByteArray version = data;
+    version[4] = char(0xff);
+    version[5] = char(0xff);
+    QVERIFY(!DocumentIO::readBinary(version.constData(), version.size(), shapes));
+
+    // A chunk claiming more bytes than the file has
+    QByteArray chunk = data;
+    chunk[8] = char(0xff);
+    chunk[9] = char(0xff);
+    chunk[10] = char(0xff);
+    chunk[11] = char(0x7f);
+    QVERIFY(!DocumentIO::readBinary(chunk.constData(), chunk.size(), shapes));
+    QVERIFY(shapes.isEmpty());
+}
+
+void DocumentIOTest::corruptRecord(){
+    // A freehand record whose point count runs past the payload
+    DocumentIO::Record record = DocumentIO::encodeRecord(m_shapes[1]);
+    record.payload.chop(3);
+    QVERIFY(!DocumentIO::decodeRecord(record));
+
+    // Inside a document the broken record fails the whole load
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    QVERIFY(DocumentIO::writeBinary(QVector<DocumentIO::Record>{DocumentIO::encodeRecord(m_shapes[0]), record}, &buffer));
+    QList<Shape*> shapes;
+    QVERIFY(!DocumentIO::readBinary(buffer.data().constData(), buffer.data().size(), shapes));
+    QVERIFY(shapes.isEmpty());
+}
+
+void DocumentIOTest::damagedBytes(){
+    // Whatever a single damaged byte turns the file into, reading it stays in bounds
+    const QByteArray data = encode(m_shapes);
+    for(int i = 0; i < data.size(); ++i){
+        QByteArray damaged = data;
+        damaged[i] = char(~quint8(damaged[i]));
+        QList<Shape*> shapes;
+        if(!DocumentIO::readBinary(damaged.constData(), damaged.size(), shapes))
+            QVERIFY(shapes.isEmpty());
+        qDeleteAll(shapes);
+    }
+}
+
+QTEST_GUILESS_MAIN(DocumentIOTest)
+#include "document_io_test.moc"
@@ -0,0 +1,238 @@
+#include "../include/DocumentJournal.h"
+#include "../include/DocumentIO.h"
+#include "../include/shapes/RectangleShape.h"
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QtTest>
+
+// The saved file with its journal replayed has to be the document as it was
+// last edited, whatever a crash or a later save did to the journal.
+class DocumentJournalTest : public QObject{
+
+    Q_OBJECT
+
+    private slots:
+        void init();
+        void cleanup();
+
+        void appendThenReplay();
+        void tornLastEntry();
+        void compactKeepsState();
+        void rebaseKeepsState();
+        void staleJournal();
+
+    private:
+        static DocumentIO::Record rectRecord(const QRect& rect);
+        // One line per shape, comparable with QCOMPARE
+        static QStringList describe(const QVector<DocumentJournal::Entry>& entries);
+        QStringList replayed();
+        void edit(DocumentJournal& journal);
+
+        QTemporaryDir* m_dir = nullptr;
+        QString m_document;
+};
+
+void DocumentJournalTest::init(){
+    m_dir = new QTemporaryDir();
+    QVERIFY(m_dir->isValid());
+    m_document = m_dir->filePath(QString("document") + DocumentIO::BinarySuffix);
+
+    // Shapes 1..3 of the saved document
+    QVector<DocumentIO::Record> records;
+    for(int i = 0; i < 3; ++i)
+        records.append(rectRecord(QRect(10 * i, 0, 50, 20)));
+    QVERIFY(DocumentIO::save(records, m_document));
+}
+
+void DocumentJournalTest::cleanup(){
+    delete m_dir;
+    m_dir = nullptr;
+}
+
+DocumentIO::Record DocumentJournalTest::rectRecord(const QRect& rect){
+    RectangleShape shape(rect);
+    return DocumentIO::encodeRecord(&shape);
+}
+
+QStringList DocumentJournalTest::describe(const QVector<DocumentJournal::Entry>& entries){
+    QStringList lines;
+    for(const DocumentJournal::Entry& entry : entries){
+        const QRect& bounds = entry.record.bounds;
+        lines.append(QString("id %1 z %2 type %3 bounds %4,%5 %6x%7 payload %8")
+                         .arg(entry.id).arg(entry.z).arg(int(entry.record.type))
+                         .arg(bounds.x()).arg(bounds.y()).arg(bounds.width()).arg(bounds.height())
+                         .arg(QString::fromLatin1(entry.record.payload.toHex())));
+    }
+    return lines;
+}
+
+QStringList DocumentJournalTest::replayed(){
+    QVector<DocumentJournal::Entry> entries;
+    if(!DocumentJournal::replay(m_document, entries))
+        return {"replay failed"};
+    return describe(entries);
+}
+
+// Touches every op: a new shape, an edited one, a removed one and a restack
+void DocumentJournalTest::edit(DocumentJournal& journal){
+    QVERIFY(journal.put(4, 4, rectRecord(QRect(100, 100, 30, 30))));
+    QVERIFY(journal.put(2, 2, rectRecord(QRect(15, 5, 60, 25))));
+    QVERIFY(journal.remove(1));
+    QVERIFY(journal.setZ(3, 10));
+}
+
+void DocumentJournalTest::appendThenReplay(){
+    DocumentJournal journal;
+    journal.setDocument(m_document);
+    QVERIFY(!DocumentJournal::canRecover(m_document));
+
+    edit(journal);
+    QVERIFY(journal.position() > 0);
+    QVERIFY(DocumentJournal::canRecover(m_document));
+
+    QVector<DocumentJournal::Entry> entries;
+    QVERIFY(DocumentJournal::replay(m_document, entries));
+    QCOMPARE(entries.size(), 3);
+    QCOMPARE(entries[0].id, quint64(2));
+    QCOMPARE(entries[0].record.bounds, rectRecord(QRect(15, 5, 60, 25)).bounds);
+    QCOMPARE(entries[1].id, quint64(4));
+    QCOMPARE(entries[2].id, quint64(3));
+    QCOMPARE(entries[2].z, qint64(10));
+
+    journal.discard();
+    QVERIFY(!QFile::exists(DocumentJournal::fileName(m_document)));
+}
+
+void DocumentJournalTest::tornLastEntry(){
+    qint64 intact = 0;
+    QStringList before;
+    {
+        // Closed without discard(), as a crash would leave it
+        DocumentJournal journal;
+        journal.setDocument(m_document);
+        QVERIFY(journal.put(4, 4, rectRecord(QRect(100, 100, 30, 30))));
+        intact = QFileInfo(DocumentJournal::fileName(m_document)).size();
+        before = replayed();
+        QVERIFY(journal.put(2, 2, rectRecord(QRect(15, 5, 60, 25))));
+    }
+
+    QFile file(DocumentJournal::fileName(m_document));
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    const QByteArray data = file.readAll();
+
+    // The last append was cut short a few bytes before its end
+    QVERIFY(file.resize(data.size() - 3));
+    QCOMPARE(replayed(), before);
+
+    // A payload that does not match its checksum drops the entry just the same
+    QByteArray damaged = data;
+    damaged[damaged.size() - 1] = char(~quint8(damaged[damaged.size() - 1]));
+    QVERIFY(file.seek(0));
+    QCOMPARE(file.write(damaged), qint64(damaged.size()));
+    file.close();
+    QCOMPARE(replayed(), before);
+
+    // Resuming drops the torn bytes and appends after the last intact entry
+    DocumentJournal journal;
+    QVERIFY(journal.resume(m_document));
+    QCOMPARE(QFileInfo(file.fileName()).size(), intact);
+    QVERIFY(journal.remove(4));
+    QCOMPARE(replayed().size(), 3);
+}
+
+void DocumentJournalTest::compactKeepsState(){
+    DocumentJournal journal;
+    journal.setDocument(m_document);
+    edit(journal);
+    // More edits of the same shapes, which compaction folds into one each
+    for(int i = 0; i < 10; ++i)
+        QVERIFY(journal.put(4, 4, rectRecord(QRect(100 + i, 100, 30, 30))));
+    QVERIFY(journal.setZ(4, -1));
+    QVERIFY(journal.setZ(1, 20));
+    const QStringList before = replayed();
+    const qint64 size = journal.position();
+
+    QVERIFY(journal.compact());
+    QCOMPARE(replayed(), before);
+    QVERIFY(journal.position() < size);
+    QCOMPARE(journal.compactedSize(), journal.position());
+
+    // The compacted journal keeps taking edits
+    QVERIFY(journal.remove(2));
+    QVERIFY(journal.compact());
+    QCOMPARE(replayed().size(), before.size() - 1);
+}
+
+void DocumentJournalTest::rebaseKeepsState(){
+    DocumentJournal journal;
+    journal.setDocument(m_document);
+    edit(journal);
+    const qint64 saved = journal.position();
+    QVector<DocumentJournal::Entry> entries;
+    QVERIFY(DocumentJournal::replay(m_document, entries));
+
+    // An edit made while the save below was being written
+    QVERIFY(journal.put(5, 11, rectRecord(QRect(0, 200, 40, 40))));
+    const QStringList current = replayed();
+
+    // Saved in z order; the shapes keep their ids and z values through the Base entry
+    QVector<DocumentIO::Record> records;
+    QVector<DocumentJournal::Slot> slots;
+    for(const DocumentJournal::Entry& entry : entries){
+        records.append(entry.record);
+        slots.append({entry.id, entry.z});
+    }
+    QVERIFY(DocumentIO::save(records, m_document));
+    QVERIFY(journal.rebase(m_document, slots, saved));
+    QVERIFY(journal.position() > 0);
+    QCOMPARE(replayed(), current);
+
+    // Without carried over edits there is nothing left to recover
+    QVERIFY(journal.rebase(m_document, slots, journal.position()));
+    QVERIFY(!DocumentJournal::canRecover(m_document));
+    QVERIFY(journal.setZ(2, 30));
+    QVector<DocumentJournal::Entry> restacked;
+    QVERIFY(DocumentJournal::replay(m_document, restacked));
+    QCOMPARE(restacked.size(), entries.size());
+    QCOMPARE(restacked.last().id, quint64(2));
+}
+
+void DocumentJournalTest::staleJournal(){
+    {
+        DocumentJournal journal;
+        journal.setDocument(m_document);
+        edit(journal);
+    }
+    QVERIFY(DocumentJournal::canRecover(m_document));
+
+    // Same size, but written after the journal was
+    QFile document(m_document);
+    QVERIFY(document.open(QIODevice::ReadWrite));
+    const QDateTime modified = document.fileTime(QFileDevice::FileModificationTime);
+    QVERIFY(document.setFileTime(modified.addSecs(2), QFileDevice::FileModificationTime));
+    document.close();
+
+    QVector<DocumentJournal::Entry> entries;
+    QVERIFY(!DocumentJournal::canRecover(m_document));
+    QVERIFY(!DocumentJournal::replay(m_document, entries));
+    DocumentJournal journal;
+    QVERIFY(!journal.resume(m_document));
+
+    // Restoring the time makes it current again; a different size does not
+    QVERIFY(document.open(QIODevice::ReadWrite));
+    QVERIFY(document.setFileTime(modified, QFileDevice::FileModificationTime));
+    document.close();
+    QVERIFY(DocumentJournal::canRecover(m_document));
+
+    QVERIFY(DocumentIO::save(QVector<DocumentIO::Record>{rectRecord(QRect(0, 0, 5, 5))}, m_document));
+    QVERIFY(document.open(QIODevice::ReadWrite));
+    QVERIFY(document.setFileTime(modified, QFileDevice::FileModificationTime));
+    document.close();
+    QVERIFY(!DocumentJournal::canRecover(m_document));
+    QVERIFY(!DocumentJournal::replay(m_document, entries));
+}
+
+QTEST_GUILESS_MAIN(DocumentJournalTest)
+#include "document_journal_test.moc"
@@ -0,0 +1,183 @@
+#include "DocumentIO.h"
+#include "DocumentRenderer.h"
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+#include <QtMath>
+#include <cstdio>
+
+// Batch rasterizer: paint-render [options] documents...
+// Every document becomes <output>/<name>.png, or <name>_<row>_<column>.png
+// for each tile when a tile grid is given.
+
+struct RenderOptions{
+    QString outputDir;
+    QSize size;         // whole document in pixels, empty to use dpi
+    double dpi = 96;
+    int columns = 1;
+    int rows = 1;
+    QColor background = Qt::white;
+    bool parallelTiles = false;     // spread each image over the global pool's threads
+};
+
+static bool parseGrid(const QString& text, int& first, int& second){
+    const QStringList parts = text.toLower().split('x');
+    if(parts.size() != 2)
+        return false;
+    bool okFirst = false;
+    bool okSecond = false;
+    first = parts[0].toInt(&okFirst);
+    second = parts[1].toInt(&okSecond);
+    return okFirst && okSecond && first > 0 && second > 0;
+}
+
+// Renders one document; returns the number of tiles written, -1 on failure
+static int renderDocument(const QString& fileName, const RenderOptions& options, QString& error){
+    QList<Shape*> shapes;
+    if(!DocumentIO::load(fileName, shapes)){
+        qDeleteAll(shapes);
+        error = "cannot read document";
+        return -1;
+    }
+
+    QRect bounds = DocumentRenderer::documentBounds(shapes);
+    if(bounds.isEmpty())
+        bounds = QRect(0, 0, 1, 1);
+
+    // Output size either fits the requested box or follows the DPI (96 = one pixel per unit)
+    QSize total;
+    if(options.size.isValid())
+        total = QSizeF(bounds.size()).scaled(QSizeF(options.size), Qt::KeepAspectRatio).toSize().expandedTo(QSize(1, 1));
+    else
+        total = (QSizeF(bounds.size()) * (options.dpi / 96.0)).toSize().expandedTo(QSize(1, 1));
+
+    const QString baseName = QFileInfo(fileName).completeBaseName();
+    const double scaleX = double(total.width()) / bounds.width();
+    const double scaleY = double(total.height()) / bounds.height();
+    int written = 0;
+    for(int row = 0; row < options.rows; ++row){
+        for(int column = 0; column < options.columns; ++column){
+            // Pixel edges of the tile; the last row and column take the remainder
+            const int left = total.width() * column / options.columns;
+            const int right = total.width() * (column + 1) / options.columns;
+            const int top = total.height() * row / options.rows;
+            const int bottom = total.height() * (row + 1) / options.rows;
+            if(right <= left || bottom <= top)
+                continue;
+
+            QImage image(right - left, bottom - top, QImage::Format_ARGB32_Premultiplied);
+            image.setDotsPerMeterX(qRound(options.dpi / 0.0254));
+            image.setDotsPerMeterY(qRound(options.dpi / 0.0254));
+            QRectF source(bounds.left() + left / scaleX, bounds.top() + top / scaleY,
+                          (right - left) / scaleX, (bottom - top) / scaleY);
+            if(options.parallelTiles)
+                DocumentRenderer::renderTiled(shapes, source, image, options.background);
+            else
+                DocumentRenderer::render(shapes, source, image, options.background);
+
+            QString name = options.rows * options.columns == 1
+                ? baseName + ".png"
+                : QString("%1_%2_%3.png").arg(baseName).arg(row).arg(column);
+            if(!image.save(QDir(options.outputDir).filePath(name))){
+                qDeleteAll(shapes);
+                error = "cannot write " + name;
+                return -1;
+            }
+            ++written;
+        }
+    }
+
+    qDeleteAll(shapes);
+    return written;
+}
+
+int main(int argc, char* argv[])
+{
+    // Rendering goes to QImage only, no display is needed
+    if(qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+    QGuiApplication::setApplicationName("paint-render");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders Paint documents to PNG images.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("documents", "Documents to render (.paint or .paintb).", "documents...");
+    QCommandLineOption outputOption({"o", "output"}, "Directory for the images (default: current).", "dir", ".");
+    QCommandLineOption sizeOption({"s", "size"}, "Fit the whole document into WxH pixels.", "WxH");
+    QCommandLineOption dpiOption({"d", "dpi"}, "Resolution when no size is given; 96 renders 1:1.", "dpi", "96");
+    QCommandLineOption tilesOption({"t", "tiles"}, "Split each image into a grid of CxR tiles.", "CxR", "1x1");
+    QCommandLineOption jobsOption({"j", "jobs"}, "Documents rendered at once (default: one per core).", "n");
+    QCommandLineOption backgroundOption("background", "Background color (default: white).", "color", "white");
+    parser.addOptions({outputOption, sizeOption, dpiOption, tilesOption, jobsOption, backgroundOption});
+    parser.process(app);
+
+    const QStringList files = parser.positionalArguments();
+    if(files.isEmpty())
+        parser.showHelp(1);
+
+    RenderOptions options;
+    options.outputDir = parser.value(outputOption);
+    options.dpi = parser.value(dpiOption).toDouble();
+    options.background = QColor(parser.value(backgroundOption));
+    if(parser.isSet(sizeOption)){
+        int width = 0;
+        int height = 0;
+        if(!parseGrid(parser.value(sizeOption), width, height)){
+            std::fprintf(stderr, "paint-render: invalid size '%s'\n", qPrintable(parser.value(sizeOption)));
+            return 1;
+        }
+        options.size = QSize(width, height);
+    }
+    if(!parseGrid(parser.value(tilesOption), options.columns, options.rows)){
+        std::fprintf(stderr, "paint-render: invalid tile grid '%s'\n", qPrintable(parser.value(tilesOption)));
+        return 1;
+    }
+    if(options.dpi <= 0 || !options.background.isValid()){
+        std::fprintf(stderr, "paint-render: invalid dpi or background\n");
+        return 1;
+    }
+    if(!QDir().mkpath(options.outputDir)){
+        std::fprintf(stderr, "paint-render: cannot create '%s'\n", qPrintable(options.outputDir));
+        return 1;
+    }
+
+    // One document per task; shapes are created, drawn and deleted on the worker
+    QThreadPool pool;
+    if(parser.isSet(jobsOption))
+        pool.setMaxThreadCount(qMax(1, parser.value(jobsOption).toInt()));
+    // Too few documents to keep every core busy: the idle ones take tiles instead
+    options.parallelTiles = files.size() < QThread::idealThreadCount();
+
+    QMutex mutex;
+    int failed = 0;
+    int tiles = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for(const QString& file : files){
+        pool.start([&, file](){
+            QString error;
+            int written = renderDocument(file, options, error);
+            QMutexLocker locker(&mutex);
+            if(written < 0){
+                ++failed;
+                std::fprintf(stderr, "paint-render: %s: %s\n", qPrintable(file), qPrintable(error));
+            }
+            else{
+                tiles += written;
+            }
+        });
+    }
+    pool.waitForDone();
+
+    const double seconds = qMax(timer.nsecsElapsed() / 1e9, 1e-9);
+    const int rendered = files.size() - failed;
+    std::printf("Rendered %d of %d documents (%d images) in %.3f s with %d workers: %.2f documents/s\n",
+                rendered, int(files.size()), tiles, seconds, pool.maxThreadCount(), rendered / seconds);
+    return failed == 0 ? 0 : 1;
+}